@@ -5,6 +5,15 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -13,14 +22,174 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <cstring>
+#include <cstdio>
 #include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <sched.h>
+#include <dirent.h>
+
+extern char** environ;
 #endif
 
+class ConcurrentLauncher;
+class ShardRunner;
 
 // ну поехали
 class BackgroundLauncher {
+public:
+    // как именно порождать процесс на юниксе (на винде всегда CreateProcess)
+    enum class SpawnBackend {
+        Default,    // взять глобальную настройку (setSpawnBackend)
+        Fork,       // классический fork + execvp, копирует таблицы страниц родителя
+        VFork,      // vfork + execvp, родитель спит до exec, память общая
+        PosixSpawn, // posix_spawnp, в glibc это clone(CLONE_VM|CLONE_VFORK)
+        Zygote      // просим маленький заранее форкнутый помощник (startZygote)
+    };
+
+#ifndef _WIN32
+    // итог завершившегося процесса
+    struct ExitInfo {
+        pid_t pid;
+        std::string program;
+        int exitCode;    // код выхода, -1 если убит сигналом или статус неизвестен
+        int termSignal;  // номер сигнала, 0 если вышел сам
+        int jobId;       // id из submit(), 0 для обычного launch
+        int spawnError;  // errno, если задачу из очереди не удалось запустить (pid тогда -1)
+        double wallSeconds;
+        double userSeconds;
+        double sysSeconds;
+        long maxRssKb;           // пиковый RSS после exec, 0 - не больше пика родителя, точно неизвестен
+        long voluntarySwitches;  // ru_nvcsw - ждал I/O и т.п.
+        long involuntarySwitches; // ru_nivcsw - вытеснен планировщиком
+        bool timedOut;           // сняли по дедлайну (или не стартовал, дедлайн пачки вышел)
+
+        ExitInfo()
+            : pid(-1), exitCode(-1), termSignal(0), jobId(0), spawnError(0),
+              wallSeconds(0), userSeconds(0), sysSeconds(0),
+              maxRssKb(0), voluntarySwitches(0), involuntarySwitches(0), timedOut(false) {}
+    };
+
+    typedef std::function<void(const ExitInfo&)> ExitCallback;
+    typedef std::function<bool(const ExitInfo&)> ExitFilter;
+
+    enum class UsageFormat {
+        Csv,
+        JsonLines
+    };
+
+    // что делать с stdout/stderr ребенка
+    enum class OutputMode {
+        Inherit,    // как раньше: общий с родителем
+        Callback,   // куски по мере поступления в LaunchOptions::onOutput
+        RingBuffer, // последние ringCapacity байт, забирать через takeOutput
+        Splice      // splice() из пайпа прямо в *Target fd, мимо user space.
+                    // Target может быть неблокирующим пайпом: при переполнении ждем его EPOLLOUT
+    };
+
+    // автоматическая раскладка: каждый следующий запуск - на следующее ядро (или узел NUMA)
+    // из LaunchOptions::cpus, а если он пуст - из sched_getaffinity родителя
+    enum class Placement {
+        None,
+        RoundRobinCpu,
+        RoundRobinNode
+    };
+
+    enum { KeepNice = 1000 }; // LaunchOptions::niceValue: не менять nice
+
+    // stream: 1 - stdout, 2 - stderr. size == 0 означает EOF.
+    // В режиме Splice данных не видно: data == nullptr, size - сколько байт ушло в target
+    typedef std::function<void(pid_t pid, int stream, const char* data, size_t size)> OutputCallback;
+
+    struct LaunchOptions {
+        SpawnBackend backend;
+        OutputMode stdoutMode;
+        OutputMode stderrMode;
+        OutputCallback onOutput;
+        size_t ringCapacity;
+        int stdoutTarget; // куда сплайсить в режиме Splice
+        int stderrTarget;
+        std::vector<std::string> env; // "KEY=VALUE"; пусто - окружение родителя
+        int timeoutMs;   // дедлайн, 0 - без него. По истечении stopSignal, через graceMs - SIGKILL
+        int graceMs;
+        int stopSignal;
+        int stdinFd;  // подставить ребенку как stdin, -1 - как у родителя
+        int stdoutFd; // то же для stdout, только при stdoutMode == Inherit
+        // все ниже применяется в ребенке до exec. posix_spawn так не умеет,
+        // поэтому с этими настройками PosixSpawn молча заменяется на VFork
+        std::vector<int> cpus; // маска affinity; при placement - пул для раскладки
+        Placement placement;
+        int niceValue;     // KeepNice - как у родителя
+        int schedPolicy;   // SCHED_OTHER/BATCH/IDLE/FIFO/RR, -1 - как у родителя
+        int schedPriority; // для SCHED_FIFO/RR
+        // кэш результатов (см. setResultCache), только для launchAndWait с CommandResult.
+        // Ключ: программа (путь, размер, mtime), argv, cwd, переменные cacheEnv и содержимое cacheInputs.
+        // Со stdinFd кэшируется, только если это файл из cacheInputs, иначе вход не виден ключу
+        bool cacheResult;
+        std::vector<std::string> cacheInputs; // файлы, от которых зависит результат
+        std::vector<std::string> cacheEnv;    // имена переменных, от которых зависит результат
+
+        LaunchOptions()
+            : backend(SpawnBackend::Default),
+              stdoutMode(OutputMode::Inherit), stderrMode(OutputMode::Inherit),
+              ringCapacity(64 * 1024), stdoutTarget(-1), stderrTarget(-1),
+              timeoutMs(0), graceMs(2000), stopSignal(SIGTERM), stdinFd(-1), stdoutFd(-1),
+              placement(Placement::None), niceValue(KeepNice), schedPolicy(-1), schedPriority(0),
+              cacheResult(false) {}
+    };
+
+    // итог launchAndWait с перехватом: вывод не печатается, а собирается сюда целиком
+    struct CommandResult {
+        int exitCode;
+        std::string out;
+        std::string err;
+        bool fromCache; // ответ из кэша, процесс не запускался
+
+        CommandResult() : exitCode(-1), fromCache(false) {}
+    };
+
+    struct PathCacheStats {
+        size_t hits;
+        size_t misses;
+        size_t invalidations; // сменился PATH или что-то поменялось в его каталогах
+
+        PathCacheStats() : hits(0), misses(0), invalidations(0) {}
+    };
+
+    struct CacheStats {
+        size_t hits;
+        size_t misses;
+        size_t stores;
+        size_t evictions;
+        size_t uncacheable; // не нашелся входной файл, убит сигналом или по дедлайну
+        uint64_t bytes;     // сколько сейчас занято на диске (оценка между пересчетами)
+
+        CacheStats() : hits(0), misses(0), stores(0), evictions(0), uncacheable(0), bytes(0) {}
+    };
+#endif
+
 private:
     BackgroundLauncher() = delete;
+    friend class ConcurrentLauncher; // берет отсюда spawn* и разбор статуса
+    friend class ShardRunner;        // и защиту от SIGPIPE
+
+#ifdef _WIN32
+    typedef DWORD ProcessId;
+#else
+    typedef pid_t ProcessId;
+#endif
     
     struct ProcessInfo {
 #ifdef _WIN32
@@ -28,11 +197,164 @@ private:
         DWORD pid;
 #else
         pid_t pid;
+        int pidfd; // -1, если ядро без pidfd_open и ждем через SIGCHLD
+        int jobId; // 0 - запущен напрямую, не из очереди
+        int timerFd; // timerfd дедлайна в epoll, -1 если дедлайна нет
+        int deadlineStage; // 0 - ждем, 1 - послан stopSignal, 2 - послан SIGKILL
+        int graceMs;
+        int stopSignal;
+        std::chrono::steady_clock::time_point started;
 #endif
         std::string program;
     };
+
+#ifndef _WIN32
+    struct QueuedJob {
+        int id;
+        int priority;
+        std::string program;
+        std::vector<std::string> args;
+        LaunchOptions options;
+
+        // больший приоритет раньше, при равном - кто раньше пришел
+        bool operator<(const QueuedJob& other) const {
+            if (priority != other.priority) {
+                return priority < other.priority;
+            }
+            return id > other.id;
+        }
+    };
+
+    // уже разрешенные настройки размещения: POD, уходит зиготе как есть
+    struct ChildSetup {
+        cpu_set_t cpus;
+        bool hasCpus;
+        bool hasNice;
+        int niceValue;
+        int policy; // -1 - не трогать
+        int priority;
+    };
+
+    // кольцевой буфер: хранит последние capacity байт, старое перезаписывается
+    class RingBuffer {
+    public:
+        explicit RingBuffer(size_t capacity = 0) : _buf(capacity), _head(0), _size(0), _dropped(0) {}
+
+        void append(const char* data, size_t size) {
+            size_t cap = _buf.size();
+            if (cap == 0) {
+                _dropped += size;
+                return;
+            }
+            if (size >= cap) {
+                _dropped += _size + size - cap;
+                memcpy(_buf.data(), data + size - cap, cap);
+                _head = 0;
+                _size = cap;
+                return;
+            }
+            size_t tail = (_head + _size) % cap;
+            size_t first = std::min(size, cap - tail);
+            memcpy(_buf.data() + tail, data, first);
+            memcpy(_buf.data(), data + first, size - first);
+            _size += size;
+            if (_size > cap) {
+                _dropped += _size - cap;
+                _head = (_head + _size - cap) % cap;
+                _size = cap;
+            }
+        }
+
+        std::string take() {
+            std::string result;
+            result.reserve(_size);
+            size_t cap = _buf.size();
+            size_t first = std::min(_size, cap - _head);
+            result.append(_buf.data() + _head, first);
+            result.append(_buf.data(), _size - first);
+            _head = 0;
+            _size = 0;
+            return result;
+        }
+
+        size_t size() const { return _size; }
+        size_t dropped() const { return _dropped; }
+
+    private:
+        std::vector<char> _buf;
+        size_t _head;
+        size_t _size;
+        size_t _dropped;
+    };
+
+    struct OutputStream {
+        int fd;          // наш конец пайпа, -1 после EOF
+        OutputMode mode;
+        int target;
+        bool copyFallback; // target не умеет splice - качаем через read/write
+        bool stalled;      // target переполнен, ждем его EPOLLOUT вместо нашего EPOLLIN
+        int watchFd;       // через что ждем target: он сам или его dup, если его уже ждет другой поток
+        RingBuffer ring;
+    };
+
+    struct ProcessOutput {
+        OutputStream streams[2]; // stdout, stderr
+        OutputCallback callback;
+        bool reaped;
+    };
+#endif
     
-    static std::vector<ProcessInfo> processes;
+    // реестр: pid -> процесс, плюс сколько процессов с каждым именем программы
+    static std::unordered_map<ProcessId, ProcessInfo> processes;
+    static std::unordered_map<std::string, size_t> programIndex;
+    static SpawnBackend defaultBackend;
+    static int lastError; // errno (или GetLastError) последнего неудачного запуска
+
+#ifndef _WIN32
+    static int epollFd;
+    static int sigchldFd;          // signalfd на SIGCHLD, только если нет pidfd
+    static bool sigchldBlocked;
+    static sigset_t savedSigmask;  // маска до блокировки SIGCHLD, ее отдаем детям
+    static bool needScan;          // пройтись по процессам без pidfd через WNOHANG
+    static std::unordered_set<pid_t> unwatched; // процессы без pidfd
+    static std::deque<ExitInfo> pending; // пожатые, но еще не отданные через waitAny
+    static ExitCallback exitCallback;
+
+    static std::priority_queue<QueuedJob> jobQueue;
+    static size_t maxConcurrency; // 0 - по числу ядер
+    static size_t runningJobs;
+    static int nextJobId;
+
+    static std::unordered_map<pid_t, ProcessOutput> outputs;
+
+    static pid_t zygotePid;
+    static int zygoteSock;
+
+    static bool batchActive; // идет waitForAll с дедлайном
+    static std::chrono::steady_clock::time_point batchDeadline;
+    static int batchGraceMs;
+
+    static std::deque<ExitInfo> usageRecords; // по записи на каждого пожатого ребенка
+    static size_t usageHistoryLimit;
+    static std::ofstream usageSink;
+    static UsageFormat usageSinkFormat;
+
+    static std::string cacheDir;    // пусто - кэш выключен
+    static uint64_t cacheMaxBytes;
+    static CacheStats cacheStats;
+    static unsigned cacheTmpCounter;
+
+    static bool pathCacheEnabled;
+    static bool pathCacheValid;
+    static std::string pathCacheEnv; // PATH, для которого заполнен pathCache
+    static std::unordered_map<std::string, std::string> pathCache;
+    static int pathWatchFd;          // inotify на каталоги PATH
+    static PathCacheStats pathCacheStats;
+
+    static unsigned placementCursor; // следующий слот round-robin
+    static std::vector<std::vector<int>> numaNodes; // ядра каждого узла, читаются один раз
+    static bool numaLoaded;
+#endif
     
     static std::string buildCommandLine(const std::string& program, const std::vector<std::string>& args) {
         std::string commandLine;
@@ -70,6 +392,65 @@ private:
         return commandLine;
     }
 
+    static void addProcess(const ProcessInfo& procInfo) {
+        processes[procInfo.pid] = procInfo;
+        programIndex[procInfo.program]++;
+#ifndef _WIN32
+        if (procInfo.pidfd < 0) {
+            unwatched.insert(procInfo.pid);
+        }
+#endif
+    }
+
+    static void removeProcess(std::unordered_map<ProcessId, ProcessInfo>::iterator it) {
+        auto name = programIndex.find(it->second.program);
+        if (name != programIndex.end() && --name->second == 0) {
+            programIndex.erase(name);
+        }
+#ifdef _WIN32
+        if (it->second.handle != NULL) {
+            CloseHandle(it->second.handle);
+        }
+#else
+        if (it->second.pidfd >= 0) {
+            close(it->second.pidfd); // из epoll уйдет сам
+        } else {
+            unwatched.erase(it->second.pid);
+        }
+        if (it->second.timerFd >= 0) {
+            close(it->second.timerFd);
+        }
+#endif
+        processes.erase(it);
+    }
+
+#ifdef _WIN32
+    // выкинуть из реестра уже завершившихся, не блокируясь
+    static void pruneExited() {
+        for (auto it = processes.begin(); it != processes.end();) {
+            auto next = it;
+            ++next;
+            if (WaitForSingleObject(it->second.handle, 0) == WAIT_OBJECT_0) {
+                removeProcess(it);
+            }
+            it = next;
+        }
+    }
+#else
+    // жив ли ребенок из реестра, не пожиная его: WNOWAIT оставляет зомби для waitAny/poll.
+    // Запросы состояния не должны запускать задачи из очереди и звать колбэки, как reapReady
+    static bool isAlive(pid_t pid) {
+        siginfo_t si;
+        memset(&si, 0, sizeof(si));
+        int r;
+        do {
+            r = waitid(P_PID, static_cast<id_t>(pid), &si, WEXITED | WNOHANG | WNOWAIT);
+        } while (r < 0 && errno == EINTR);
+        // ECHILD - пожал кто-то другой, его тоже не считаем
+        return r == 0 && si.si_pid == 0;
+    }
+#endif
+
 #ifdef _WIN32
     static ProcessInfo launchWindows(const std::string& program, const std::vector<std::string>& args) {
         std::string commandLine = buildCommandLine(program, args);
@@ -101,147 +482,2449 @@ private:
             CloseHandle(processInfo.hThread);
             procInfo.handle = processInfo.hProcess;
             procInfo.pid = processInfo.dwProcessId;
+            lastError = 0;
             return procInfo;
         }
         
-        std::cerr << "Failed to create process: " << GetLastError() << std::endl;
+        lastError = static_cast<int>(GetLastError());
         return procInfo;
     }
 #else
 
-    static ProcessInfo launchUnix(const std::string& program, const std::vector<std::string>& args) {
-        pid_t pid = fork();
-        
-        ProcessInfo procInfo;
-        procInfo.program = program;
-        procInfo.pid = -1;
-        
-        if (pid == 0) {
+    // argv собираем до fork/vfork: после vfork ребенку нельзя трогать кучу
+    static std::vector<char*> buildArgv(const std::string& program, const std::vector<std::string>& args) {
+        std::vector<char*> argv;
+        argv.reserve(args.size() + 2);
+        argv.push_back(const_cast<char*>(program.c_str()));
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        return argv;
+    }
 
-            std::vector<char*> argv;
-            argv.push_back(const_cast<char*>(program.c_str()));
-            
-            for (const auto& arg : args) {
-                argv.push_back(const_cast<char*>(arg.c_str()));
-            }
-            argv.push_back(nullptr);
-            
-            if (execvp(program.c_str(), argv.data()) == -1) {
-                std::cerr << "execvp failed: " << strerror(errno) << std::endl;
-                exit(EXIT_FAILURE);
+    static std::vector<char*> buildEnvp(const std::vector<std::string>* env) {
+        std::vector<char*> envp;
+        if (env == nullptr || env->empty()) {
+            for (char** e = environ; *e != nullptr; e++) {
+                envp.push_back(*e);
             }
-        } else if (pid > 0) {
-            procInfo.pid = pid;
-            return procInfo;
         } else {
-            std::cerr << "fork failed: " << strerror(errno) << std::endl;
+            envp.reserve(env->size() + 1);
+            for (const auto& var : *env) {
+                envp.push_back(const_cast<char*>(var.c_str()));
+            }
         }
-        
-        return procInfo;
+        envp.push_back(nullptr);
+        return envp;
     }
-#endif
 
-public:
+    static void reapFailed(pid_t pid) {
+        int status;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    }
 
-    static bool launch(const std::string& program, const std::vector<std::string>& args = {}) {
-#ifdef _WIN32
-        ProcessInfo procInfo = launchWindows(program, args);
-        if (procInfo.handle != NULL) {
-            processes.push_back(procInfo);
-            return true;
+    // fork + пайп с O_CLOEXEC: при удачном exec пайп закроется сам,
+    // при неудачном ребенок успеет записать туда errno
+    // stdio[i] >= 0 - что подставить ребенку вместо fd i (nullptr - все как у родителя).
+    // Вызывается и после vfork, поэтому только async-signal-safe вызовы
+    static void redirectChildStdio(const int* stdio) {
+        if (stdio == nullptr) {
+            return;
         }
-#else
-        ProcessInfo procInfo = launchUnix(program, args);
-        if (procInfo.pid > 0) {
-            processes.push_back(procInfo);
-            return true;
+        for (int i = 0; i < 3; i++) {
+            if (stdio[i] < 0) {
+                continue;
+            }
+            if (stdio[i] == i) {
+                fcntl(i, F_SETFD, 0);
+            } else {
+                dup2(stdio[i], i);
+            }
         }
-#endif
-        return false;
     }
-    
-    static int launchAndWait(const std::string& program, const std::vector<std::string>& args = {}) {
-#ifdef _WIN32
-        ProcessInfo procInfo = launchWindows(program, args);
-        if (procInfo.handle == NULL) {
-            return -1;
+
+    // тоже после vfork: только системные вызовы. Возвращает errno или 0
+    static int applyChildSetup(const ChildSetup* setup) {
+        if (setup == nullptr) {
+            return 0;
         }
-        
-        DWORD exitCode;
-        WaitForSingleObject(procInfo.handle, INFINITE);
-        GetExitCodeProcess(procInfo.handle, &exitCode);
-        CloseHandle(procInfo.handle);
-        
-        return static_cast<int>(exitCode);
-#else
-        ProcessInfo procInfo = launchUnix(program, args);
-        if (procInfo.pid < 0) {
+        if (setup->hasCpus && sched_setaffinity(0, sizeof(setup->cpus), &setup->cpus) < 0) {
+            return errno;
+        }
+        if (setup->policy >= 0) {
+            sched_param param;
+            param.sched_priority = setup->priority;
+            if (sched_setscheduler(0, setup->policy, &param) < 0) {
+                return errno;
+            }
+        }
+        if (setup->hasNice && setpriority(PRIO_PROCESS, 0, setup->niceValue) < 0) {
+            return errno;
+        }
+        return 0;
+    }
+
+    // file - что исполнять (уже разрешенный путь или имя для поиска по PATH), argv[0] - как назвать
+    static pid_t spawnFork(const char* file, char* const* argv, char* const* envp, const int* stdio,
+                           const ChildSetup* setup, int& err) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            err = errno;
             return -1;
         }
-        
-        int status;
-        waitpid(procInfo.pid, &status, 0);
-        
-        if (WIFEXITED(status)) {
-            return WEXITSTATUS(status);
-        } else if (WIFSIGNALED(status)) {
-            std::cerr << "Process terminated by signal: " << WTERMSIG(status) << std::endl;
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            if (sigchldBlocked) {
+                sigprocmask(SIG_SETMASK, &savedSigmask, nullptr);
+            }
+            redirectChildStdio(stdio);
+            int childErr = applyChildSetup(setup);
+            if (childErr == 0) {
+                execvpe(file, argv, envp);
+                childErr = errno;
+            }
+            ssize_t unused = write(fds[1], &childErr, sizeof(childErr));
+            (void)unused;
+            _exit(127);
+        }
+
+        close(fds[1]);
+        if (pid < 0) {
+            err = errno;
+            close(fds[0]);
             return -1;
-        } else {
+        }
+
+        int childErr = 0;
+        ssize_t n;
+        do {
+            n = read(fds[0], &childErr, sizeof(childErr));
+        } while (n < 0 && errno == EINTR);
+        close(fds[0]);
+
+        if (n == sizeof(childErr)) {
+            reapFailed(pid);
+            err = childErr;
             return -1;
         }
-#endif
+        return pid;
     }
-    
-    static size_t waitForAll() {
-        size_t count = 0; //колво завершенных процессов
-        
-#ifdef _WIN32
-        for (auto& procInfo : processes) {
-            if (procInfo.handle != NULL) {
-                WaitForSingleObject(procInfo.handle, INFINITE);
-                CloseHandle(procInfo.handle);
-                procInfo.handle = NULL;
-                count++;
+
+    // vfork: родитель заморожен, пока ребенок не сделает exec или _exit,
+    // поэтому errno можно вернуть прямо через общую память
+    static pid_t spawnVFork(const char* file, char* const* argv, char* const* envp, const int* stdio,
+                            const ChildSetup* setup, int& err) {
+        volatile int childErr = 0;
+
+        pid_t pid = vfork();
+        if (pid == 0) {
+            if (sigchldBlocked) {
+                sigprocmask(SIG_SETMASK, &savedSigmask, nullptr);
             }
+            redirectChildStdio(stdio);
+            int setupErr = applyChildSetup(setup);
+            if (setupErr != 0) {
+                childErr = setupErr;
+                _exit(127);
+            }
+            execvpe(file, argv, envp);
+            childErr = errno;
+            _exit(127);
         }
-#else
-        for (auto& procInfo : processes) {
-            if (procInfo.pid > 0) {
-                int status;
-                waitpid(procInfo.pid, &status, 0);
-                procInfo.pid = -1;
-                count++;
+
+        if (pid < 0) {
+            err = errno;
+            return -1;
+        }
+        if (childErr != 0) {
+            reapFailed(pid);
+            err = childErr;
+            return -1;
+        }
+        return pid;
+    }
+
+    static pid_t spawnPosix(const char* file, char* const* argv, char* const* envp, const int* stdio, int& err) {
+        posix_spawnattr_t attr;
+        posix_spawnattr_t* pattr = nullptr;
+        if (sigchldBlocked) {
+            posix_spawnattr_init(&attr);
+            posix_spawnattr_setsigmask(&attr, &savedSigmask);
+            posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+            pattr = &attr;
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_t* pactions = nullptr;
+        if (stdio != nullptr) {
+            posix_spawn_file_actions_init(&actions);
+            for (int i = 0; i < 3; i++) {
+                if (stdio[i] >= 0) {
+                    posix_spawn_file_actions_adddup2(&actions, stdio[i], i);
+                }
             }
+            pactions = &actions;
         }
-#endif
-        
-        processes.clear();
-        return count;
+
+        pid_t pid;
+        int rc = posix_spawnp(&pid, file, pactions, pattr, argv, envp);
+
+        if (pattr != nullptr) {
+            posix_spawnattr_destroy(pattr);
+        }
+        if (pactions != nullptr) {
+            posix_spawn_file_actions_destroy(pactions);
+        }
+        if (rc != 0) {
+            err = rc;
+            return -1;
+        }
+        return pid;
     }
-    
-    static size_t getRunningCount() { //колво запущенных процессов
-        return processes.size();
+
+
+    // ---- зигота: маленький помощник, форкнутый пока родитель еще легкий.
+    // Запрос по SOCK_SEQPACKET: заголовок, путь, argv и env через '\0', stdio через SCM_RIGHTS.
+    // Помощник делает clone(CLONE_PARENT), так что новый процесс - наш ребенок, а не его:
+    // pidfd/waitpid работают как обычно, а fork копирует только таблицы помощника
+
+    struct ZygoteRequest {
+        uint32_t argc;
+        uint32_t envc;
+        uint32_t fdMask; // какие из stdin/stdout/stderr приложены
+        uint32_t hasSetup;
+        ChildSetup setup;
+    };
+
+    struct ZygoteReply {
+        int32_t pid;
+        int32_t err;
+    };
+
+    enum { ZygoteMaxMessage = 256 * 1024 };
+
+    static pid_t cloneParent() {
+        return static_cast<pid_t>(syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0));
     }
-    
-    static std::vector<std::string> getRunningPrograms() { //инфа о запущенных процессах
-        std::vector<std::string> result;
-        for (const auto& procInfo : processes) {
-            result.push_back(procInfo.program);
+
+    static void zygoteServe(int sock) {
+        std::vector<char> buf(ZygoteMaxMessage);
+        std::vector<char*> argv;
+        std::vector<char*> envp;
+
+        for (;;) {
+            iovec iov;
+            iov.iov_base = buf.data();
+            iov.iov_len = buf.size();
+
+            union {
+                char data[CMSG_SPACE(3 * sizeof(int))];
+                cmsghdr align;
+            } control;
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data;
+            msg.msg_controllen = sizeof(control.data);
+
+            ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                _exit(0); // хозяин закрыл сокет или умер
+            }
+
+            int received[3] = {-1, -1, -1};
+            size_t nfds = 0;
+            for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+                    nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                    memcpy(received, CMSG_DATA(c), std::min<size_t>(nfds, 3) * sizeof(int));
+                }
+            }
+
+            ZygoteReply reply;
+            reply.pid = -1;
+            reply.err = EINVAL;
+
+            ZygoteRequest req;
+            if (static_cast<size_t>(n) >= sizeof(req)) {
+                memcpy(&req, buf.data(), sizeof(req));
+
+                // раскладываем подряд идущие строки в путь и argv/env
+                argv.clear();
+                envp.clear();
+                char* p = buf.data() + sizeof(req);
+                char* end = buf.data() + n;
+                char* file = p;
+                p += strnlen(p, end - p) + 1;
+                for (uint32_t i = 0; i < req.argc + req.envc && p < end; i++) {
+                    (i < req.argc ? argv : envp).push_back(p);
+                    p += strnlen(p, end - p) + 1;
+                }
+                argv.push_back(nullptr);
+                envp.push_back(nullptr);
+
+                int stdio[3] = {-1, -1, -1};
+                size_t next = 0;
+                for (int i = 0; i < 3; i++) {
+                    if ((req.fdMask & (1u << i)) && next < nfds) {
+                        stdio[i] = received[next++];
+                    }
+                }
+
+                if (argv.size() == req.argc + 1 && req.argc > 0 && p <= end) {
+                    int err = 0;
+                    int fds[2];
+                    if (pipe2(fds, O_CLOEXEC) < 0) {
+                        err = errno;
+                    } else {
+                        pid_t pid = cloneParent();
+                        if (pid == 0) {
+                            close(sock);
+                            close(fds[0]);
+                            // помощника могли форкнуть уже после блокировки SIGCHLD - маска у него наша
+                            if (sigchldBlocked) {
+                                sigprocmask(SIG_SETMASK, &savedSigmask, nullptr);
+                            }
+                            redirectChildStdio(stdio);
+                            int childErr = applyChildSetup(req.hasSetup ? &req.setup : nullptr);
+                            if (childErr == 0) {
+                                execvpe(file, argv.data(), envp.data());
+                                childErr = errno;
+                            }
+                            ssize_t unused = write(fds[1], &childErr, sizeof(childErr));
+                            (void)unused;
+                            _exit(127);
+                        }
+                        close(fds[1]);
+                        if (pid < 0) {
+                            err = errno;
+                        } else {
+                            int childErr = 0;
+                            ssize_t r;
+                            do {
+                                r = read(fds[0], &childErr, sizeof(childErr));
+                            } while (r < 0 && errno == EINTR);
+                            if (r == sizeof(childErr)) {
+                                err = childErr; // зомби пожмет хозяин, это его ребенок
+                            }
+                            reply.pid = pid;
+                        }
+                        close(fds[0]);
+                    }
+                    reply.err = err;
+                }
+            }
+
+            for (size_t i = 0; i < std::min<size_t>(nfds, 3); i++) {
+                close(received[i]);
+            }
+
+            ssize_t w;
+            do {
+                w = send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+            } while (w < 0 && errno == EINTR);
         }
-        return result;
     }
-    
-    static bool isProgramRunning(const std::string& program) {
-        for (const auto& procInfo : processes) {
-            if (procInfo.program.find(program) != std::string::npos) {
-                return true;
+
+    static void closeFdsExcept(int keep) {
+#ifdef SYS_close_range
+        if (syscall(SYS_close_range, 3, keep - 1, 0) == 0 &&
+            syscall(SYS_close_range, keep + 1, ~0u, 0) == 0) {
+            return;
+        }
+#endif
+        long maxFd = sysconf(_SC_OPEN_MAX);
+        if (maxFd < 0 || maxFd > 65536) {
+            maxFd = 65536;
+        }
+        for (int fd = 3; fd < maxFd; fd++) {
+            if (fd != keep) {
+                close(fd);
             }
         }
-        return false;
     }
-};
 
-std::vector<BackgroundLauncher::ProcessInfo> BackgroundLauncher::processes;
+    static bool forkZygote() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+            lastError = errno;
+            return false;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            // все лишние fd закрываем: иначе помощник держал бы чужие концы пайпов
+            closeFdsExcept(sv[1]);
+            zygoteServe(sv[1]);
+            _exit(0);
+        }
+
+        close(sv[1]);
+        if (pid < 0) {
+            lastError = errno;
+            close(sv[0]);
+            return false;
+        }
+        zygotePid = pid;
+        zygoteSock = sv[0];
+        return true;
+    }
+
+    static void stopZygoteProcess() {
+        if (zygoteSock >= 0) {
+            close(zygoteSock);
+            zygoteSock = -1;
+        }
+        if (zygotePid > 0) {
+            reapFailed(zygotePid);
+            zygotePid = -1;
+        }
+    }
+
+    static pid_t spawnZygote(const char* file, char* const* argv, char* const* envp, const int* stdio,
+                             const ChildSetup* setup, int& err) {
+        // сами помощника не поднимаем: поздний fork скопировал бы уже большой процесс,
+        // ради чего зигота и нужна. Поднимает только startZygote, в начале main
+        if (zygoteSock < 0) {
+            err = ESRCH;
+            return -1;
+        }
+
+        std::string payload(sizeof(ZygoteRequest), '\0');
+        ZygoteRequest req;
+        req.argc = 0;
+        req.envc = 0;
+        req.fdMask = 0;
+        req.hasSetup = setup != nullptr;
+        if (setup != nullptr) {
+            req.setup = *setup;
+        }
+        payload.append(file, strlen(file) + 1);
+        for (char* const* a = argv; *a != nullptr; a++) {
+            payload.append(*a, strlen(*a) + 1);
+            req.argc++;
+        }
+        for (char* const* e = envp; *e != nullptr; e++) {
+            payload.append(*e, strlen(*e) + 1);
+            req.envc++;
+        }
+        if (payload.size() > ZygoteMaxMessage) {
+            err = E2BIG;
+            return -1;
+        }
+
+        int fds[3];
+        size_t nfds = 0;
+        for (int i = 0; stdio != nullptr && i < 3; i++) {
+            if (stdio[i] >= 0) {
+                req.fdMask |= 1u << i;
+                fds[nfds++] = stdio[i];
+            }
+        }
+        memcpy(&payload[0], &req, sizeof(req));
+
+        iovec iov;
+        iov.iov_base = &payload[0];
+        iov.iov_len = payload.size();
+        union {
+            char data[CMSG_SPACE(3 * sizeof(int))];
+            cmsghdr align;
+        } control;
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (nfds > 0) {
+            msg.msg_control = control.data;
+            msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+            cmsghdr* c = CMSG_FIRSTHDR(&msg);
+            c->cmsg_level = SOL_SOCKET;
+            c->cmsg_type = SCM_RIGHTS;
+            c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+            memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+        }
+
+        ZygoteReply reply;
+        ssize_t n;
+        do {
+            n = sendmsg(zygoteSock, &msg, MSG_NOSIGNAL);
+        } while (n < 0 && errno == EINTR);
+        if (n >= 0) {
+            do {
+                n = recv(zygoteSock, &reply, sizeof(reply), 0);
+            } while (n < 0 && errno == EINTR);
+        }
+
+        if (n != sizeof(reply)) {
+            // помощник умер - дальше Zygote не работает, пока не позовут startZygote
+            err = (n < 0) ? errno : EPIPE;
+            stopZygoteProcess();
+            return -1;
+        }
+
+        if (reply.err != 0) {
+            if (reply.pid > 0) {
+                reapFailed(reply.pid);
+            }
+            err = reply.err;
+            return -1;
+        }
+        return reply.pid;
+    }
+
+    // ---- кэш путей: имя программы -> абсолютный путь, чтобы exec не перебирал PATH
+    // (execve на каждый каталог, пока не найдется). Сбрасывается, если поменялся PATH
+    // или inotify сообщил о чем угодно в его каталогах. Каталоги PATH, которых нет,
+    // не отслеживаются; если кэш из-за этого устарел, exec вернет ENOENT и мы поищем заново
+
+    // как execvp ищет программу; пусто - не нашли
+    static std::string findInPath(const std::string& program) {
+        if (program.find('/') != std::string::npos) {
+            return program;
+        }
+        const char* path = getenv("PATH");
+        std::stringstream ss(path != nullptr ? path : "/bin:/usr/bin");
+        std::string dir;
+        while (std::getline(ss, dir, ':')) {
+            std::string candidate = (dir.empty() ? "." : dir) + "/" + program;
+            struct stat st;
+            if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+                return candidate;
+            }
+        }
+        return std::string();
+    }
+
+    static void watchPathDirs(const std::string& path) {
+        if (pathWatchFd >= 0) {
+            close(pathWatchFd);
+        }
+        pathWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (pathWatchFd < 0) {
+            return;
+        }
+        std::stringstream ss(path);
+        std::string dir;
+        while (std::getline(ss, dir, ':')) {
+            if (!dir.empty() && dir[0] == '/') {
+                inotify_add_watch(pathWatchFd, dir.c_str(),
+                                  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                                  IN_DELETE_SELF | IN_MOVE_SELF);
+            }
+        }
+    }
+
+    // путь для exec. Кэш выключен, нет inotify или программы нет в PATH - program как есть:
+    // exec сам поищет ее по PATH (и вернет ENOENT, если не найдет)
+    static std::string resolveProgram(const std::string& program) {
+        if (program.find('/') != std::string::npos || !pathCacheEnabled) {
+            return program;
+        }
+
+        // любое событие - сбросить все и поставить наблюдение заново (каталог мог исчезнуть)
+        if (pathWatchFd >= 0) {
+            char events[4096];
+            bool changed = false;
+            while (read(pathWatchFd, events, sizeof(events)) > 0) {
+                changed = true;
+            }
+            if (changed) {
+                pathCacheValid = false;
+                pathCacheStats.invalidations++;
+            }
+        }
+
+        const char* env = getenv("PATH");
+        std::string path = env != nullptr ? env : "";
+        if (!pathCacheValid || path != pathCacheEnv) {
+            if (pathCacheValid) {
+                pathCacheStats.invalidations++;
+            }
+            pathCache.clear();
+            pathCacheEnv = path;
+            watchPathDirs(path);
+            pathCacheValid = true;
+        }
+        if (pathWatchFd < 0) {
+            return program; // без inotify не узнаем об изменениях - не кэшируем
+        }
+
+        auto it = pathCache.find(program);
+        if (it != pathCache.end()) {
+            pathCacheStats.hits++;
+            return it->second;
+        }
+        pathCacheStats.misses++;
+        std::string resolved = findInPath(program);
+        if (resolved.empty()) {
+            return program;
+        }
+        // относительный каталог в PATH зависит от cwd - такое не запоминаем
+        if (resolved[0] == '/') {
+            pathCache[program] = resolved;
+        }
+        return resolved;
+    }
+
+    static ProcessInfo launchUnix(const std::string& program, const std::vector<std::string>& args,
+                                  SpawnBackend backend = SpawnBackend::Default, const int* stdio = nullptr,
+                                  const std::vector<std::string>* env = nullptr,
+                                  const ChildSetup* setup = nullptr) {
+        ProcessInfo procInfo;
+        procInfo.program = program;
+        procInfo.pid = -1;
+        procInfo.pidfd = -1;
+        procInfo.jobId = 0;
+        procInfo.timerFd = -1;
+        procInfo.deadlineStage = 0;
+        procInfo.graceMs = 0;
+        procInfo.stopSignal = SIGTERM;
+        procInfo.started = std::chrono::steady_clock::now();
+
+        if (backend == SpawnBackend::Default) {
+            backend = defaultBackend;
+        }
+        if (setup != nullptr && backend == SpawnBackend::PosixSpawn) {
+            // affinity и nice через posix_spawnattr не задать, а vfork по цене тот же
+            backend = SpawnBackend::VFork;
+        }
+
+        std::vector<char*> argv = buildArgv(program, args);
+        std::vector<char*> envp = buildEnvp(env);
+        std::string file = resolveProgram(program);
+        int err = 0;
+        pid_t pid = spawnWith(backend, file.c_str(), argv.data(), envp.data(), stdio, setup, err);
+
+        // запомненный путь пропал, а inotify этого не видел - забыть и искать по PATH
+        if (pid < 0 && err == ENOENT && file != program) {
+            pathCache.erase(program);
+            err = 0;
+            pid = spawnWith(backend, program.c_str(), argv.data(), envp.data(), stdio, setup, err);
+        }
+
+        lastError = err;
+        procInfo.pid = pid;
+        return procInfo;
+    }
+
+    static pid_t spawnWith(SpawnBackend backend, const char* file, char* const* argv, char* const* envp,
+                           const int* stdio, const ChildSetup* setup, int& err) {
+        switch (backend) {
+        case SpawnBackend::VFork:
+            return spawnVFork(file, argv, envp, stdio, setup, err);
+        case SpawnBackend::PosixSpawn:
+            return spawnPosix(file, argv, envp, stdio, err);
+        case SpawnBackend::Zygote:
+            return spawnZygote(file, argv, envp, stdio, setup, err);
+        default:
+            return spawnFork(file, argv, envp, stdio, setup, err);
+        }
+    }
+
+    // ---- реапинг по событиям: pidfd в epoll, без pidfd - signalfd(SIGCHLD)
+
+    static bool initReaper() {
+        if (epollFd < 0) {
+            epollFd = epoll_create1(EPOLL_CLOEXEC);
+        }
+        return epollFd >= 0;
+    }
+
+    static int openPidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+        return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+        (void)pid;
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+    // SIGCHLD надо заблокировать, иначе signalfd его не увидит.
+    // Блокируется только в вызывающем потоке - запасной путь рассчитан на однопоточного хозяина
+    static bool initSigchldFd() {
+        if (sigchldFd >= 0) {
+            return true;
+        }
+
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        if (!sigchldBlocked) {
+            pthread_sigmask(SIG_BLOCK, &mask, &savedSigmask);
+            sigchldBlocked = true;
+        }
+
+        sigchldFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (sigchldFd < 0) {
+            return false;
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0; // 0 - метка signalfd, у процессов там pid
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, sigchldFd, &ev);
+
+        // ребенок мог умереть до блокировки, его SIGCHLD уже потерян
+        needScan = true;
+        return true;
+    }
+
+    static void watchProcess(ProcessInfo& procInfo) {
+        if (!initReaper()) {
+            return;
+        }
+
+        procInfo.pidfd = openPidfd(procInfo.pid);
+        if (procInfo.pidfd >= 0) {
+            fcntl(procInfo.pidfd, F_SETFD, FD_CLOEXEC);
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = static_cast<uint64_t>(procInfo.pid);
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, procInfo.pidfd, &ev) == 0) {
+                return;
+            }
+            close(procInfo.pidfd);
+            procInfo.pidfd = -1;
+        }
+
+        initSigchldFd();
+    }
+
+    // ru_maxrss ребенка - максимум по всем его адресным пространствам, включая то, что было
+    // до exec: копию родителя после fork, а после vfork/posix_spawn - самого родителя.
+    // Снаружи их не разделить (у зомби VmHWM в /proc уже нет), поэтому верим ru_maxrss,
+    // только если он выше нашего собственного пика - унаследовать больше ребенок не мог
+    static long childPeakRss(const struct rusage& usage) {
+        struct rusage self;
+        if (getrusage(RUSAGE_SELF, &self) < 0 || usage.ru_maxrss <= self.ru_maxrss) {
+            return 0;
+        }
+        return usage.ru_maxrss;
+    }
+
+    static void fillExitInfo(ExitInfo& info, int status, bool known) {
+        info.exitCode = -1;
+        info.termSignal = 0;
+        if (!known) {
+            return;
+        }
+        if (WIFEXITED(status)) {
+            info.exitCode = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            info.termSignal = WTERMSIG(status);
+        }
+    }
+
+    static ExitInfo makeExitInfo(const ProcessInfo& procInfo, int status, bool known, const struct rusage& usage) {
+        ExitInfo info;
+        info.pid = procInfo.pid;
+        info.program = procInfo.program;
+        info.jobId = procInfo.jobId;
+        info.wallSeconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - procInfo.started).count();
+        info.userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        info.sysSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        info.maxRssKb = childPeakRss(usage);
+        info.voluntarySwitches = usage.ru_nvcsw;
+        info.involuntarySwitches = usage.ru_nivcsw;
+        info.timedOut = procInfo.deadlineStage > 0;
+        fillExitInfo(info, status, known);
+        recordUsage(info);
+        return info;
+    }
+
+    static std::string jsonEscape(const std::string& str) {
+        std::string result;
+        for (char c : str) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                result += buf;
+            } else {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    static std::string csvEscape(const std::string& str) {
+        if (str.find_first_of(",\"\n") == std::string::npos) {
+            return str;
+        }
+        std::string result = "\"";
+        for (char c : str) {
+            if (c == '"') {
+                result += '"';
+            }
+            result += c;
+        }
+        return result + "\"";
+    }
+
+    static void recordUsage(const ExitInfo& info) {
+        if (usageHistoryLimit > 0) {
+            usageRecords.push_back(info);
+            while (usageRecords.size() > usageHistoryLimit) {
+                usageRecords.pop_front();
+            }
+        }
+
+        if (!usageSink.is_open()) {
+            return;
+        }
+        std::ostringstream line;
+        if (usageSinkFormat == UsageFormat::Csv) {
+            line << info.pid << ',' << csvEscape(info.program) << ',' << info.jobId << ','
+                 << info.exitCode << ',' << info.termSignal << ','
+                 << info.wallSeconds << ',' << info.userSeconds << ',' << info.sysSeconds << ','
+                 << info.maxRssKb << ',' << info.voluntarySwitches << ',' << info.involuntarySwitches;
+        } else {
+            line << "{\"pid\":" << info.pid
+                 << ",\"program\":\"" << jsonEscape(info.program) << "\""
+                 << ",\"job\":" << info.jobId
+                 << ",\"exit\":" << info.exitCode
+                 << ",\"signal\":" << info.termSignal
+                 << ",\"wall_s\":" << info.wallSeconds
+                 << ",\"user_s\":" << info.userSeconds
+                 << ",\"sys_s\":" << info.sysSeconds
+                 << ",\"max_rss_kb\":" << info.maxRssKb
+                 << ",\"nvcsw\":" << info.voluntarySwitches
+                 << ",\"nivcsw\":" << info.involuntarySwitches << "}";
+        }
+        usageSink << line.str() << '\n';
+        usageSink.flush();
+    }
+
+    // неблокирующий waitpid для одного процесса из реестра
+    static bool reapPid(pid_t pid, std::vector<ExitInfo>& out) {
+        auto it = processes.find(pid);
+        if (it == processes.end()) {
+            return false;
+        }
+
+        int status = 0;
+        struct rusage usage;
+        memset(&usage, 0, sizeof(usage));
+        pid_t r;
+        do {
+            r = wait4(pid, &status, WNOHANG, &usage);
+        } while (r < 0 && errno == EINTR);
+
+        if (r == 0) {
+            return false;
+        }
+
+        // все, что ребенок успел написать до выхода, отдаем раньше ExitInfo
+        auto output = outputs.find(pid);
+        if (output != outputs.end()) {
+            pumpOutput(pid, 1);
+            pumpOutput(pid, 2);
+            output = outputs.find(pid);
+            if (output != outputs.end()) {
+                output->second.reaped = true;
+                releaseOutput(output);
+            }
+            // колбэк вывода мог запустить новый процесс, а вставка - перестроить реестр
+            it = processes.find(pid);
+            if (it == processes.end()) {
+                return false;
+            }
+        }
+
+        // r < 0 (ECHILD) - процесс пожал кто-то другой, статус потерян
+        ExitInfo info = makeExitInfo(it->second, status, r == pid, usage);
+        if (info.jobId != 0) {
+            runningJobs--;
+        }
+        removeProcess(it);
+        out.push_back(info);
+        return true;
+    }
+
+    static void scanUnwatched(std::vector<ExitInfo>& out) {
+        std::vector<pid_t> pids(unwatched.begin(), unwatched.end());
+        for (pid_t pid : pids) {
+            reapPid(pid, out);
+        }
+    }
+
+    // ---- перехват вывода: пайпы в том же epoll, метка = (номер потока << 32) | pid
+
+    static uint64_t outputTag(pid_t pid, int stream) {
+        return (static_cast<uint64_t>(stream) << 32) | static_cast<uint32_t>(pid);
+    }
+
+    static bool captures(OutputMode mode) {
+        return mode != OutputMode::Inherit;
+    }
+
+    static void deliverOutput(pid_t pid, ProcessOutput& out, int stream, const char* data, size_t size) {
+        OutputStream& os = out.streams[stream - 1];
+        if (os.mode == OutputMode::RingBuffer) {
+            os.ring.append(data, size);
+        } else if (os.mode == OutputMode::Splice) {
+            // target без поддержки splice: обычная копия
+            size_t total = size;
+            while (size > 0) {
+                ssize_t w = write(os.target, data, size);
+                if (w < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (w <= 0) {
+                    break;
+                }
+                data += w;
+                size -= static_cast<size_t>(w);
+            }
+            if (out.callback && total > size) {
+                OutputCallback callback = out.callback; // колбэк может удалить запись вместе с собой
+                callback(pid, stream, nullptr, total - size);
+            }
+        } else if (out.callback) {
+            OutputCallback callback = out.callback;
+            callback(pid, stream, data, size);
+        }
+    }
+
+    static void unwatchTarget(OutputStream& os) {
+        if (!os.stalled) {
+            return;
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, os.watchFd, nullptr);
+        if (os.watchFd != os.target) {
+            close(os.watchFd);
+        }
+        os.watchFd = -1;
+        os.stalled = false;
+    }
+
+    // закрыть поток и освободить запись, если больше держать нечего. Колбэк о конце
+    // потока зовется последним: после него запись могла уже исчезнуть
+    static void closeOutput(pid_t pid, std::unordered_map<pid_t, ProcessOutput>::iterator it, int stream) {
+        OutputStream& os = it->second.streams[stream - 1];
+        unwatchTarget(os);
+        close(os.fd); // из epoll уйдет сам
+        os.fd = -1;
+        OutputCallback callback;
+        if (os.mode == OutputMode::Callback || os.mode == OutputMode::Splice) {
+            callback = it->second.callback;
+        }
+        releaseOutput(it);
+        if (callback) {
+            callback(pid, stream, nullptr, 0);
+        }
+    }
+
+    // ring-буферы живут до takeOutput, остальное удаляем, как только все закрылось
+    static void releaseOutput(std::unordered_map<pid_t, ProcessOutput>::iterator it) {
+        for (int i = 0; i < 2; i++) {
+            const OutputStream& os = it->second.streams[i];
+            if (os.fd >= 0 || (os.mode == OutputMode::RingBuffer && os.ring.size() > 0)) {
+                return;
+            }
+        }
+        if (it->second.reaped) {
+            outputs.erase(it);
+        }
+    }
+
+    // splice/write в пайп без читателя шлет SIGPIPE. На время перекачки его блокируем,
+    // а появившийся за это время снимаем, чтобы он не прилетел после разблокировки
+    static bool blockSigpipe(sigset_t& saved) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &set, &saved);
+        sigset_t pendingSet;
+        sigpending(&pendingSet);
+        return sigismember(&pendingSet, SIGPIPE) == 1;
+    }
+
+    static void restoreSigpipe(const sigset_t& saved, bool wasPending) {
+        if (!wasPending) {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGPIPE);
+            timespec zero = {0, 0};
+            while (sigtimedwait(&set, nullptr, &zero) == SIGPIPE) {}
+        }
+        pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+    }
+
+    // метка "target снова принимает": 4 - для stdout, 5 - для stderr
+    enum { TargetReadyTag = 4 };
+
+    // splice вернул EAGAIN при непустом пайпе - значит, уперлись в target.
+    // Снимаем EPOLLIN (иначе epoll будит впустую) и ждем, пока target освободится
+    static bool stallOutput(pid_t pid, OutputStream& os, int stream) {
+        int avail = 0;
+        if (ioctl(os.fd, FIONREAD, &avail) < 0 || avail == 0) {
+            return false;
+        }
+        epoll_event ev;
+        ev.events = EPOLLOUT | EPOLLONESHOT;
+        ev.data.u64 = outputTag(pid, TargetReadyTag + stream - 1);
+        int watch = os.target;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, watch, &ev) < 0) {
+            // stdout и stderr идут в один target, и его уже ждет второй поток. epoll различает
+            // записи по номеру fd, так что ждем через копию дескриптора
+            if (errno != EEXIST || (watch = dup(os.target)) < 0) {
+                return false;
+            }
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, watch, &ev) < 0) {
+                close(watch);
+                return false;
+            }
+        }
+        ev.events = 0;
+        ev.data.u64 = outputTag(pid, stream);
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, os.fd, &ev);
+        os.watchFd = watch;
+        os.stalled = true;
+        return true;
+    }
+
+    static void resumeOutput(pid_t pid, int stream) {
+        auto it = outputs.find(pid);
+        if (it == outputs.end()) {
+            return;
+        }
+        OutputStream& os = it->second.streams[stream - 1];
+        if (!os.stalled) {
+            return;
+        }
+        unwatchTarget(os);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = outputTag(pid, stream);
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, os.fd, &ev);
+        pumpOutput(pid, stream);
+    }
+
+    // прочитать из пайпа все, что есть, не блокируясь
+    static void pumpOutput(pid_t pid, int stream) {
+        auto it = outputs.find(pid);
+        if (it == outputs.end()) {
+            return;
+        }
+        OutputStream& os = it->second.streams[stream - 1];
+        if (os.fd < 0 || os.stalled) {
+            return;
+        }
+
+        if (os.mode == OutputMode::Splice) {
+            sigset_t saved;
+            bool wasPending = blockSigpipe(saved);
+            drainOutput(pid, stream);
+            restoreSigpipe(saved, wasPending);
+        } else {
+            drainOutput(pid, stream);
+        }
+    }
+
+    // колбэки могут звать takeOutput/discardOutput/spawn, так что запись ищем заново
+    // на каждом шаге и не держим ссылок на нее через вызов колбэка
+    static void drainOutput(pid_t pid, int stream) {
+        char buf[64 * 1024];
+        for (;;) {
+            auto it = outputs.find(pid);
+            if (it == outputs.end()) {
+                return;
+            }
+            OutputStream& os = it->second.streams[stream - 1];
+            if (os.fd < 0 || os.stalled) {
+                return;
+            }
+
+            ssize_t n;
+            int err;
+            if (os.mode == OutputMode::Splice && !os.copyFallback) {
+                n = splice(os.fd, nullptr, os.target, nullptr, sizeof(buf), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                err = errno;
+                if (n < 0 && err == EINVAL) {
+                    os.copyFallback = true;
+                    continue;
+                }
+                if (n < 0 && err == EAGAIN && stallOutput(pid, os, stream)) {
+                    return;
+                }
+                if (n > 0 && it->second.callback) {
+                    OutputCallback callback = it->second.callback;
+                    callback(pid, stream, nullptr, static_cast<size_t>(n));
+                }
+            } else {
+                n = read(os.fd, buf, sizeof(buf));
+                err = errno;
+                if (n > 0) {
+                    deliverOutput(pid, it->second, stream, buf, static_cast<size_t>(n));
+                }
+            }
+
+            if (n > 0) {
+                continue;
+            }
+            if (n < 0 && err == EINTR) {
+                continue;
+            }
+            if (n == 0 || (err != EAGAIN && err != EWOULDBLOCK)) {
+                closeOutput(pid, it, stream);
+            }
+            return;
+        }
+    }
+
+    // ---- размещение: маска и приоритеты считаются в родителе, в ребенке только применяются
+
+    // "0-3,8,10-11" -> номера ядер
+    static std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            int first = 0;
+            int last = 0;
+            int fields = sscanf(item.c_str(), "%d-%d", &first, &last);
+            if (fields < 1) {
+                continue;
+            }
+            if (fields == 1) {
+                last = first;
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    static void loadNumaNodes() {
+        if (numaLoaded) {
+            return;
+        }
+        numaLoaded = true;
+        DIR* dir = opendir("/sys/devices/system/node");
+        if (dir == nullptr) {
+            return;
+        }
+        std::vector<std::pair<int, std::vector<int>>> found;
+        while (dirent* entry = readdir(dir)) {
+            int node;
+            if (sscanf(entry->d_name, "node%d", &node) != 1) {
+                continue;
+            }
+            std::ifstream in(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+            std::string list;
+            if (std::getline(in, list)) {
+                found.push_back(std::make_pair(node, parseCpuList(list)));
+            }
+        }
+        closedir(dir);
+        std::sort(found.begin(), found.end());
+        for (const auto& node : found) {
+            numaNodes.push_back(node.second);
+        }
+    }
+
+    // false (и lastError) при неверном номере ядра или пустом пуле
+    static bool resolveChildSetup(const LaunchOptions& options, ChildSetup& setup, bool& needed) {
+        CPU_ZERO(&setup.cpus);
+        setup.hasCpus = false;
+        setup.hasNice = options.niceValue != KeepNice;
+        setup.niceValue = options.niceValue;
+        setup.policy = options.schedPolicy;
+        setup.priority = options.schedPriority;
+
+        std::vector<int> pool = options.cpus;
+        for (int cpu : pool) {
+            if (cpu < 0 || cpu >= CPU_SETSIZE) {
+                lastError = EINVAL;
+                return false;
+            }
+        }
+        if (pool.empty() && options.placement != Placement::None) {
+            cpu_set_t allowed;
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                    if (CPU_ISSET(cpu, &allowed)) {
+                        pool.push_back(cpu);
+                    }
+                }
+            }
+            if (pool.empty()) {
+                lastError = EINVAL;
+                return false;
+            }
+        }
+
+        if (options.placement == Placement::RoundRobinCpu) {
+            CPU_SET(pool[placementCursor++ % pool.size()], &setup.cpus);
+        } else if (options.placement == Placement::RoundRobinNode) {
+            // узлы, у которых есть ядра из пула; без sysfs весь пул - один узел
+            loadNumaNodes();
+            std::vector<std::vector<int>> nodes;
+            for (const auto& node : numaNodes) {
+                std::vector<int> usable;
+                for (int cpu : node) {
+                    if (std::find(pool.begin(), pool.end(), cpu) != pool.end()) {
+                        usable.push_back(cpu);
+                    }
+                }
+                if (!usable.empty()) {
+                    nodes.push_back(usable);
+                }
+            }
+            if (nodes.empty()) {
+                nodes.push_back(pool);
+            }
+            for (int cpu : nodes[placementCursor++ % nodes.size()]) {
+                CPU_SET(cpu, &setup.cpus);
+            }
+        } else {
+            for (int cpu : pool) {
+                CPU_SET(cpu, &setup.cpus);
+            }
+        }
+        setup.hasCpus = CPU_COUNT(&setup.cpus) > 0;
+
+        needed = setup.hasCpus || setup.hasNice || setup.policy >= 0;
+        return true;
+    }
+
+    // запуск с пайпами под перехват и регистрацией в реестре
+    static pid_t startProcess(const std::string& program, const std::vector<std::string>& args,
+                              const LaunchOptions& options, int jobId) {
+        ChildSetup setup;
+        bool needSetup = false;
+        if (!resolveChildSetup(options, setup, needSetup)) {
+            return -1;
+        }
+
+        const OutputMode modes[2] = {options.stdoutMode, options.stderrMode};
+        const int targets[2] = {options.stdoutTarget, options.stderrTarget};
+        int readEnds[2] = {-1, -1};
+        int writeEnds[2] = {-1, -1};
+        bool capturing = false;
+
+        for (int i = 0; i < 2; i++) {
+            if (!captures(modes[i])) {
+                continue;
+            }
+            if (modes[i] == OutputMode::Splice && targets[i] < 0) {
+                lastError = EBADF;
+                return -1;
+            }
+            int fds[2];
+            if (pipe2(fds, O_CLOEXEC) < 0) {
+                lastError = errno;
+                for (int j = 0; j < 2; j++) {
+                    if (readEnds[j] >= 0) close(readEnds[j]);
+                    if (writeEnds[j] >= 0) close(writeEnds[j]);
+                }
+                return -1;
+            }
+            readEnds[i] = fds[0];
+            writeEnds[i] = fds[1];
+            capturing = true;
+        }
+
+        int stdio[3] = {options.stdinFd, writeEnds[0], writeEnds[1]};
+        if (!captures(options.stdoutMode)) {
+            stdio[1] = options.stdoutFd;
+        }
+        bool redirect = stdio[0] >= 0 || stdio[1] >= 0 || stdio[2] >= 0;
+
+        ProcessInfo procInfo = launchUnix(program, args, options.backend, redirect ? stdio : nullptr,
+                                          &options.env, needSetup ? &setup : nullptr);
+
+        for (int i = 0; i < 2; i++) {
+            if (writeEnds[i] >= 0) {
+                close(writeEnds[i]);
+            }
+        }
+        if (procInfo.pid <= 0) {
+            for (int i = 0; i < 2; i++) {
+                if (readEnds[i] >= 0) {
+                    close(readEnds[i]);
+                }
+            }
+            return -1;
+        }
+
+        procInfo.jobId = jobId;
+        procInfo.graceMs = options.graceMs;
+        procInfo.stopSignal = options.stopSignal;
+        watchProcess(procInfo);
+        addProcess(procInfo);
+
+        ProcessInfo& registered = processes[procInfo.pid];
+        if (options.timeoutMs > 0) {
+            armDeadline(registered, options.timeoutMs);
+        }
+        if (batchActive) {
+            armBatchDeadline(registered);
+        }
+
+        // pid мог достаться от процесса, чей ring-буфер так и не забрали - это уже чужой вывод
+        discardOutput(procInfo.pid);
+        if (capturing) {
+            ProcessOutput& out = outputs[procInfo.pid];
+            out.callback = options.onOutput;
+            out.reaped = false;
+            for (int i = 0; i < 2; i++) {
+                OutputStream& os = out.streams[i];
+                os.fd = readEnds[i];
+                os.mode = modes[i];
+                os.target = targets[i];
+                os.copyFallback = false;
+                os.stalled = false;
+                os.watchFd = -1;
+                os.ring = RingBuffer(modes[i] == OutputMode::RingBuffer ? options.ringCapacity : 0);
+                if (os.fd < 0) {
+                    continue;
+                }
+                fcntl(os.fd, F_SETFL, fcntl(os.fd, F_GETFL) | O_NONBLOCK);
+                epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.u64 = outputTag(procInfo.pid, i + 1);
+                epoll_ctl(epollFd, EPOLL_CTL_ADD, os.fd, &ev);
+            }
+        }
+        return procInfo.pid;
+    }
+
+    // ---- кэш результатов: файл на ключ в cacheDir/ab/cdef..., ключ - SHA-256 всего,
+    // от чего зависит вывод. Запись через временный файл и rename, так что кэш можно
+    // делить между процессами. Вытеснение - самые давно использованные (по mtime)
+
+    class Sha256 {
+    public:
+        Sha256() : _length(0), _used(0) {
+            static const uint32_t init[8] = {
+                0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+            };
+            memcpy(_state, init, sizeof(_state));
+        }
+
+        void update(const void* data, size_t size) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            _length += size;
+            while (size > 0) {
+                size_t take = std::min(size, sizeof(_block) - _used);
+                memcpy(_block + _used, p, take);
+                _used += take;
+                p += take;
+                size -= take;
+                if (_used == sizeof(_block)) {
+                    compress();
+                    _used = 0;
+                }
+            }
+        }
+
+        // строки с длиной впереди: ("ab","c") и ("a","bc") не должны совпасть
+        void field(const std::string& str) {
+            uint64_t size = str.size();
+            update(&size, sizeof(size));
+            update(str.data(), str.size());
+        }
+
+        std::string hex() {
+            uint64_t bits = _length * 8;
+            unsigned char pad = 0x80;
+            update(&pad, 1);
+            unsigned char zero = 0;
+            while (_used != 56) {
+                update(&zero, 1);
+            }
+            unsigned char tail[8];
+            for (int i = 0; i < 8; i++) {
+                tail[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+            }
+            update(tail, sizeof(tail));
+
+            char buf[65];
+            for (int i = 0; i < 8; i++) {
+                snprintf(buf + 8 * i, 9, "%08x", _state[i]);
+            }
+            return std::string(buf, 64);
+        }
+
+    private:
+        uint32_t _state[8];
+        unsigned char _block[64];
+        uint64_t _length;
+        size_t _used;
+
+        static uint32_t rotr(uint32_t x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        void compress() {
+            static const uint32_t k[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+            };
+
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = (static_cast<uint32_t>(_block[4 * i]) << 24) | (static_cast<uint32_t>(_block[4 * i + 1]) << 16) |
+                       (static_cast<uint32_t>(_block[4 * i + 2]) << 8) | static_cast<uint32_t>(_block[4 * i + 3]);
+            }
+            for (int i = 16; i < 64; i++) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            uint32_t v[8];
+            memcpy(v, _state, sizeof(v));
+            for (int i = 0; i < 64; i++) {
+                uint32_t s1 = rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25);
+                uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+                uint32_t t1 = v[7] + s1 + ch + k[i] + w[i];
+                uint32_t s0 = rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22);
+                uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+                memmove(v + 1, v, 7 * sizeof(uint32_t));
+                v[4] += t1;
+                v[0] = t1 + s0 + maj;
+            }
+            for (int i = 0; i < 8; i++) {
+                _state[i] += v[i];
+            }
+        }
+    };
+
+    static bool hashFile(const std::string& path, Sha256& hash) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        char buf[64 * 1024];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                close(fd);
+                return false;
+            }
+            hash.update(buf, static_cast<size_t>(n));
+        }
+        close(fd);
+        return true;
+    }
+
+    // ключ или пустая строка, если результат не кэшируется (нет входного файла и т.п.)
+    static std::string cacheKey(const std::string& program, const std::vector<std::string>& args,
+                                const LaunchOptions& options) {
+        Sha256 hash;
+        hash.field("lab2-result-cache-1");
+
+        // сама программа: вместо содержимого, как ccache, берем путь, размер и mtime
+        // голое имя от resolveProgram - кэш путей не помог; stat("sort") смотрел бы в cwd
+        std::string resolved = resolveProgram(program);
+        if (resolved.find('/') == std::string::npos) {
+            resolved = findInPath(program);
+        }
+        struct stat st;
+        if (resolved.empty() || stat(resolved.c_str(), &st) != 0) {
+            return std::string();
+        }
+        hash.field(resolved);
+        hash.field(std::to_string(static_cast<long long>(st.st_size)) + ":" +
+                   std::to_string(static_cast<long long>(st.st_mtime)) + "." +
+                   std::to_string(static_cast<long long>(st.st_mtim.tv_nsec)));
+
+        hash.field(std::to_string(args.size()));
+        for (const auto& arg : args) {
+            hash.field(arg);
+        }
+
+        char cwd[4096];
+        hash.field(getcwd(cwd, sizeof(cwd)) != nullptr ? cwd : "");
+
+        for (const auto& name : options.cacheEnv) {
+            std::string value;
+            bool found = false;
+            if (options.env.empty()) {
+                const char* v = getenv(name.c_str());
+                found = v != nullptr;
+                value = found ? v : "";
+            } else {
+                for (const auto& var : options.env) {
+                    if (var.compare(0, name.size() + 1, name + "=") == 0) {
+                        value = var.substr(name.size() + 1);
+                        found = true;
+                    }
+                }
+            }
+            hash.field(name);
+            hash.field(found ? "=" + value : "");
+        }
+
+        struct stat in;
+        bool stdinListed = options.stdinFd < 0;
+        if (!stdinListed && fstat(options.stdinFd, &in) != 0) {
+            return std::string();
+        }
+        for (const auto& input : options.cacheInputs) {
+            Sha256 content;
+            if (!hashFile(input, content)) {
+                return std::string();
+            }
+            hash.field(input);
+            hash.field(content.hex());
+            if (!stdinListed && S_ISREG(in.st_mode) && stat(input.c_str(), &st) == 0 &&
+                st.st_dev == in.st_dev && st.st_ino == in.st_ino) {
+                // ребенок читает с текущей позиции, она тоже часть входа
+                off_t offset = lseek(options.stdinFd, 0, SEEK_CUR);
+                if (offset < 0) {
+                    return std::string();
+                }
+                hash.field("stdin=" + input + "@" + std::to_string(static_cast<long long>(offset)));
+                stdinListed = true;
+            }
+        }
+        // пайп или файл не из cacheInputs: что придет на вход, ключ не знает
+        if (!stdinListed) {
+            return std::string();
+        }
+        return hash.hex();
+    }
+
+    static std::string cachePath(const std::string& key) {
+        return cacheDir + "/" + key.substr(0, 2) + "/" + key.substr(2);
+    }
+
+    static bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t w = write(fd, data, size);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                return false;
+            }
+            data += w;
+            size -= static_cast<size_t>(w);
+        }
+        return true;
+    }
+
+    // формат: "LAB2CACHE <exit> <out_len> <err_len>\n", затем stdout и stderr как есть
+    static bool cacheLoad(const std::string& key, CommandResult& result) {
+        std::string path = cachePath(key);
+        std::ifstream in(path.c_str(), std::ios::binary);
+        std::string magic;
+        int exitCode;
+        size_t outSize;
+        size_t errSize;
+        if (!(in >> magic >> exitCode >> outSize >> errSize) || magic != "LAB2CACHE" || in.get() != '\n') {
+            return false;
+        }
+        std::string out(outSize, '\0');
+        std::string err(errSize, '\0');
+        if ((outSize > 0 && !in.read(&out[0], outSize)) || (errSize > 0 && !in.read(&err[0], errSize))) {
+            return false;
+        }
+
+        result.exitCode = exitCode;
+        result.out.swap(out);
+        result.err.swap(err);
+        result.fromCache = true;
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0); // для LRU: использован сейчас
+        return true;
+    }
+
+    static void cacheStore(const std::string& key, const CommandResult& result) {
+        std::string path = cachePath(key);
+        mkdir(path.substr(0, cacheDir.size() + 3).c_str(), 0755);
+
+        std::string tmp = cacheDir + "/tmp." + std::to_string(static_cast<long long>(getpid())) +
+                          "." + std::to_string(cacheTmpCounter++);
+        int fd = open(tmp.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return;
+        }
+        std::string header = "LAB2CACHE " + std::to_string(result.exitCode) + " " +
+                             std::to_string(result.out.size()) + " " + std::to_string(result.err.size()) + "\n";
+        bool ok = writeAll(fd, header.data(), header.size()) &&
+                  writeAll(fd, result.out.data(), result.out.size()) &&
+                  writeAll(fd, result.err.data(), result.err.size());
+        ok = close(fd) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            return;
+        }
+
+        cacheStats.stores++;
+        cacheStats.bytes += header.size() + result.out.size() + result.err.size();
+        if (cacheStats.bytes > cacheMaxBytes) {
+            trimCache();
+        }
+    }
+
+    static bool isHexName(const char* name, size_t length) {
+        size_t i = 0;
+        for (; name[i] != '\0'; i++) {
+            if (!isxdigit(static_cast<unsigned char>(name[i]))) {
+                return false;
+            }
+        }
+        return i == length;
+    }
+
+    // пересчитать занятое по диску (там могли писать и другие процессы) и, если больше
+    // лимита, удалять самые старые, пока не останется 90% - чтобы не чистить на каждой записи
+    static void trimCache() {
+        struct CacheEntry {
+            time_t used;
+            uint64_t size;
+            std::string path;
+
+            bool operator<(const CacheEntry& other) const {
+                return used < other.used;
+            }
+        };
+
+        std::vector<CacheEntry> entries;
+        uint64_t total = 0;
+        DIR* top = opendir(cacheDir.c_str());
+        if (top == nullptr) {
+            return;
+        }
+        while (dirent* sub = readdir(top)) {
+            // трогаем только свое: ab/ и в нем файлы из 62 hex-символов (".." тоже длины 2)
+            if (!isHexName(sub->d_name, 2)) {
+                continue;
+            }
+            std::string subPath = cacheDir + "/" + sub->d_name;
+            DIR* dir = opendir(subPath.c_str());
+            if (dir == nullptr) {
+                continue;
+            }
+            while (dirent* file = readdir(dir)) {
+                CacheEntry entry;
+                entry.path = subPath + "/" + file->d_name;
+                struct stat st;
+                if (!isHexName(file->d_name, 62) || stat(entry.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                    continue;
+                }
+                entry.used = st.st_mtime;
+                entry.size = static_cast<uint64_t>(st.st_size);
+                total += entry.size;
+                entries.push_back(entry);
+            }
+            closedir(dir);
+        }
+        closedir(top);
+
+        if (total > cacheMaxBytes) {
+            std::sort(entries.begin(), entries.end());
+            uint64_t goal = cacheMaxBytes / 10 * 9;
+            for (const auto& entry : entries) {
+                if (total <= goal) {
+                    break;
+                }
+                if (unlink(entry.path.c_str()) == 0) {
+                    total -= entry.size;
+                    cacheStats.evictions++;
+                }
+            }
+        }
+        cacheStats.bytes = total;
+    }
+
+    // ---- дедлайны: timerfd в том же epoll, метка = (3 << 32) | pid. Никакого sleep-опроса
+
+    enum { DeadlineTag = 3 };
+
+    static void sendSignal(const ProcessInfo& procInfo, int sig) {
+#ifdef SYS_pidfd_send_signal
+        // через pidfd сигнал не улетит чужому процессу, даже если pid уже переиспользован
+        if (procInfo.pidfd >= 0 && syscall(SYS_pidfd_send_signal, procInfo.pidfd, sig, nullptr, 0) == 0) {
+            return;
+        }
+#endif
+        kill(procInfo.pid, sig);
+    }
+
+    static bool setTimer(ProcessInfo& procInfo, long ms) {
+        if (procInfo.timerFd < 0) {
+            if (!initReaper()) {
+                return false;
+            }
+            procInfo.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (procInfo.timerFd < 0) {
+                return false;
+            }
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = outputTag(procInfo.pid, DeadlineTag);
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, procInfo.timerFd, &ev);
+        }
+
+        itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        if (ms <= 0) {
+            ms = 1; // нулевое время выключает таймер, а нам нужно "уже пора"
+        }
+        spec.it_value.tv_sec = ms / 1000;
+        spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+        return timerfd_settime(procInfo.timerFd, 0, &spec, nullptr) == 0;
+    }
+
+    // сколько осталось до срабатывания, -1 если таймер не взведен
+    static long timerRemainingMs(const ProcessInfo& procInfo) {
+        if (procInfo.timerFd < 0) {
+            return -1;
+        }
+        itimerspec spec;
+        if (timerfd_gettime(procInfo.timerFd, &spec) != 0) {
+            return -1;
+        }
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            return -1;
+        }
+        return spec.it_value.tv_sec * 1000 + spec.it_value.tv_nsec / 1000000;
+    }
+
+    static bool armDeadline(ProcessInfo& procInfo, long ms) {
+        if (procInfo.deadlineStage != 0) {
+            return false; // уже снимаем
+        }
+        return setTimer(procInfo, ms);
+    }
+
+    // дедлайн пачки: взводим, только если он раньше собственного дедлайна процесса
+    static void armBatchDeadline(ProcessInfo& procInfo) {
+        long left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            batchDeadline - std::chrono::steady_clock::now()).count();
+        long own = timerRemainingMs(procInfo);
+        if (procInfo.deadlineStage == 0 && (own < 0 || left < own)) {
+            procInfo.graceMs = batchGraceMs;
+            setTimer(procInfo, left);
+        }
+    }
+
+    static void onDeadline(pid_t pid) {
+        auto it = processes.find(pid);
+        if (it == processes.end()) {
+            return;
+        }
+        ProcessInfo& procInfo = it->second;
+        uint64_t expirations;
+        while (read(procInfo.timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {}
+
+        if (procInfo.deadlineStage == 0 && procInfo.graceMs > 0) {
+            procInfo.deadlineStage = 1;
+            sendSignal(procInfo, procInfo.stopSignal);
+            setTimer(procInfo, procInfo.graceMs);
+        } else if (procInfo.deadlineStage < 2) {
+            procInfo.deadlineStage = 2;
+            sendSignal(procInfo, SIGKILL);
+        }
+    }
+
+    static size_t concurrencyLimit() {
+        if (maxConcurrency > 0) {
+            return maxConcurrency;
+        }
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        return cores > 0 ? static_cast<size_t>(cores) : 1;
+    }
+
+    // запускает задачи из очереди, пока есть свободные слоты.
+    // Неудачный запуск сразу попадает в out как завершение с spawnError
+    static void dispatchJobs(std::vector<ExitInfo>& out) {
+        // дедлайн пачки вышел - не дождавшиеся очереди задачи уже не запускаем
+        if (batchActive && std::chrono::steady_clock::now() >= batchDeadline) {
+            while (!jobQueue.empty()) {
+                ExitInfo info;
+                info.program = jobQueue.top().program;
+                info.jobId = jobQueue.top().id;
+                info.spawnError = ETIMEDOUT;
+                info.timedOut = true;
+                jobQueue.pop();
+                out.push_back(info);
+            }
+        }
+
+        size_t limit = concurrencyLimit();
+        while (runningJobs < limit && !jobQueue.empty()) {
+            QueuedJob job = jobQueue.top();
+            jobQueue.pop();
+
+            if (startProcess(job.program, job.args, job.options, job.id) > 0) {
+                runningJobs++;
+                continue;
+            }
+
+            ExitInfo info;
+            info.program = job.program;
+            info.jobId = job.id;
+            info.spawnError = lastError;
+            out.push_back(info);
+        }
+    }
+
+    // dispatchJobs вне reapReady: неудачные запуски сразу отдаем в колбэк и в pending
+    static void dispatchAndPublish() {
+        std::vector<ExitInfo> failed;
+        dispatchJobs(failed);
+        for (const auto& info : failed) {
+            if (exitCallback) {
+                exitCallback(info);
+            }
+            pending.push_back(info);
+        }
+    }
+
+    // один проход epoll_wait: пожать все, что готово, и позвать колбэк
+    static void reapReady(int timeoutMs, std::vector<ExitInfo>& out) {
+        size_t first = out.size();
+
+        if (initReaper()) {
+            // если ни pidfd, ни signalfd нет - остается только опрашивать
+            bool blind = !unwatched.empty() && sigchldFd < 0;
+            if (blind && (timeoutMs < 0 || timeoutMs > 10)) {
+                timeoutMs = 10;
+            }
+            if (needScan) {
+                timeoutMs = 0;
+            }
+
+            // полный буфер событий - значит готово еще что-то, добираем без ожидания
+            epoll_event events[64];
+            int n;
+            do {
+                n = epoll_wait(epollFd, events, 64, timeoutMs);
+                for (int i = 0; i < n; i++) {
+                    uint64_t tag = events[i].data.u64;
+                    if (tag == 0) {
+                        signalfd_siginfo si;
+                        while (read(sigchldFd, &si, sizeof(si)) == sizeof(si)) {}
+                        needScan = true;
+                    } else if ((tag >> 32) == DeadlineTag) {
+                        onDeadline(static_cast<pid_t>(tag & 0xffffffffu));
+                    } else if ((tag >> 32) >= TargetReadyTag) {
+                        resumeOutput(static_cast<pid_t>(tag & 0xffffffffu),
+                                     static_cast<int>(tag >> 32) - TargetReadyTag + 1);
+                    } else if ((tag >> 32) != 0) {
+                        pumpOutput(static_cast<pid_t>(tag & 0xffffffffu), static_cast<int>(tag >> 32));
+                    } else {
+                        reapPid(static_cast<pid_t>(events[i].data.u64), out);
+                    }
+                }
+                timeoutMs = 0;
+            } while (n == 64);
+            if (blind) {
+                needScan = true;
+            }
+        } else {
+            if (timeoutMs != 0) {
+                usleep(10000);
+            }
+            needScan = true;
+        }
+
+        if (needScan) {
+            needScan = false;
+            scanUnwatched(out);
+        }
+
+        // освободились слоты - сразу запускаем следующие из очереди
+        dispatchJobs(out);
+
+        if (exitCallback) {
+            for (size_t i = first; i < out.size(); i++) {
+                exitCallback(out[i]);
+            }
+        }
+    }
+#endif
+
+public:
+
+    static void setSpawnBackend(SpawnBackend backend) {
+        defaultBackend = (backend == SpawnBackend::Default) ? SpawnBackend::PosixSpawn : backend;
+    }
+
+    static SpawnBackend getSpawnBackend() {
+        return defaultBackend;
+    }
+
+#ifndef _WIN32
+    // поднять помощника-зиготу. Звать в начале main, пока процесс маленький и однопоточный:
+    // дальше SpawnBackend::Zygote форкает уже его, а не нас. Без него Zygote-запуск
+    // падает с ESRCH (и после смерти помощника тоже) - сам launcher его не поднимает
+    static bool startZygote() {
+        if (zygoteSock >= 0) {
+            return true;
+        }
+        return forkZygote();
+    }
+
+    static void stopZygote() {
+        stopZygoteProcess();
+    }
+
+    static bool isZygoteRunning() {
+        return zygoteSock >= 0;
+    }
+#endif
+
+    // код ошибки последнего запуска: errno на юниксе (ENOENT, EACCES, ...), GetLastError на винде
+    static int getLastError() {
+        return lastError;
+    }
+
+    static bool launch(const std::string& program, const std::vector<std::string>& args = {},
+                       SpawnBackend backend = SpawnBackend::Default) {
+#ifdef _WIN32
+        (void)backend;
+        ProcessInfo procInfo = launchWindows(program, args);
+        if (procInfo.handle != NULL) {
+            addProcess(procInfo);
+            return true;
+        }
+#else
+        LaunchOptions options;
+        options.backend = backend;
+        if (startProcess(program, args, options, 0) > 0) {
+            return true;
+        }
+#endif
+        return false;
+    }
+
+#ifndef _WIN32
+    // launch с опциями (перехват вывода и т.п.), возвращает pid или -1 (см. getLastError)
+    static pid_t spawn(const std::string& program, const std::vector<std::string>& args,
+                       const LaunchOptions& options) {
+        return startProcess(program, args, options, 0);
+    }
+
+    // забрать накопленное в ring-буфере (stream: 1 - stdout, 2 - stderr)
+    static std::string takeOutput(pid_t pid, int stream) {
+        auto it = outputs.find(pid);
+        if (it == outputs.end() || stream < 1 || stream > 2) {
+            return std::string();
+        }
+        pumpOutput(pid, stream);
+        it = outputs.find(pid);
+        if (it == outputs.end()) {
+            return std::string();
+        }
+        std::string result = it->second.streams[stream - 1].ring.take();
+        releaseOutput(it);
+        return result;
+    }
+
+    // сколько байт ring-буфер потерял из-за переполнения
+    static size_t droppedOutput(pid_t pid, int stream) {
+        auto it = outputs.find(pid);
+        if (it == outputs.end() || stream < 1 || stream > 2) {
+            return 0;
+        }
+        return it->second.streams[stream - 1].ring.dropped();
+    }
+
+    // закрыть перехват и выбросить накопленное
+    static void discardOutput(pid_t pid) {
+        auto it = outputs.find(pid);
+        if (it == outputs.end()) {
+            return;
+        }
+        for (int i = 0; i < 2; i++) {
+            OutputStream& os = it->second.streams[i];
+            unwatchTarget(os);
+            if (os.fd >= 0) {
+                close(os.fd);
+            }
+        }
+        outputs.erase(it);
+    }
+#endif
+    
+    static int launchAndWait(const std::string& program, const std::vector<std::string>& args = {},
+                             SpawnBackend backend = SpawnBackend::Default) {
+#ifdef _WIN32
+        (void)backend;
+        ProcessInfo procInfo = launchWindows(program, args);
+        if (procInfo.handle == NULL) {
+            return -1;
+        }
+        
+        DWORD exitCode;
+        WaitForSingleObject(procInfo.handle, INFINITE);
+        GetExitCodeProcess(procInfo.handle, &exitCode);
+        CloseHandle(procInfo.handle);
+        
+        return static_cast<int>(exitCode);
+#else
+        ProcessInfo procInfo = launchUnix(program, args, backend);
+        if (procInfo.pid < 0) {
+            return -1;
+        }
+        
+        int status = 0;
+        struct rusage usage;
+        memset(&usage, 0, sizeof(usage));
+        pid_t r;
+        do {
+            r = wait4(procInfo.pid, &status, 0, &usage);
+        } while (r < 0 && errno == EINTR);
+        makeExitInfo(procInfo, status, r == procInfo.pid, usage);
+        
+        if (r != procInfo.pid) {
+            return -1;
+        } else if (WIFEXITED(status)) {
+            return WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            std::cerr << "Process terminated by signal: " << WTERMSIG(status) << std::endl;
+            return -1;
+        } else {
+            return -1;
+        }
+#endif
+    }
+    
+#ifndef _WIN32
+    // launchAndWait с опциями: перехват вывода, дедлайн и т.д. timedOut - сняли ли по дедлайну
+    static int launchAndWait(const std::string& program, const std::vector<std::string>& args,
+                             const LaunchOptions& options, bool* timedOut = nullptr) {
+        if (timedOut != nullptr) {
+            *timedOut = false;
+        }
+        pid_t pid = startProcess(program, args, options, 0);
+        if (pid < 0) {
+            return -1;
+        }
+
+        ExitInfo info;
+        if (!waitAny(-1, info, [pid](const ExitInfo& e) { return e.pid == pid; })) {
+            return -1;
+        }
+        if (timedOut != nullptr) {
+            *timedOut = info.timedOut;
+        }
+        return info.exitCode;
+    }
+
+    // дедлайн уже запущенному процессу (в мс от текущего момента)
+    static bool setDeadline(pid_t pid, int timeoutMs, int graceMs = 2000, int stopSignal = SIGTERM) {
+        auto it = processes.find(pid);
+        if (it == processes.end()) {
+            return false;
+        }
+        it->second.graceMs = graceMs;
+        it->second.stopSignal = stopSignal;
+        return armDeadline(it->second, timeoutMs);
+    }
+
+    // waitForAll с дедлайном на всю пачку: кто не успел - stopSignal, через graceMs SIGKILL,
+    // задачи, так и не вышедшие из очереди, отменяются. В results - все пожатые, с timedOut
+    static size_t waitForAll(int batchTimeoutMs, int graceMs = 2000, std::vector<ExitInfo>* results = nullptr) {
+        batchDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(batchTimeoutMs);
+        batchGraceMs = graceMs;
+        batchActive = true;
+        for (auto& entry : processes) {
+            armBatchDeadline(entry.second);
+        }
+
+        size_t count = 0;
+        ExitInfo info;
+        while (waitAny(-1, info)) {
+            if (results != nullptr) {
+                results->push_back(info);
+            }
+            count++;
+        }
+
+        batchActive = false;
+        return count;
+    }
+#endif
+    
+    static size_t waitForAll() {
+        size_t count = 0; //колво завершенных процессов
+        
+#ifdef _WIN32
+        for (auto& entry : processes) {
+            if (entry.second.handle != NULL) {
+                WaitForSingleObject(entry.second.handle, INFINITE);
+                CloseHandle(entry.second.handle);
+                count++;
+            }
+        }
+        processes.clear();
+        programIndex.clear();
+#else
+        // в порядке завершения, а не запуска
+        count = pending.size();
+        pending.clear();
+
+        ExitInfo info;
+        while (waitAny(-1, info)) {
+            count++;
+        }
+#endif
+        
+        return count;
+    }
+
+#ifndef _WIN32
+    // ждет любой из запущенных через launch процессов, timeoutMs < 0 - без таймаута.
+    // false - таймаут или ждать некого
+    static bool waitAny(int timeoutMs, ExitInfo& info) {
+        return waitAny(timeoutMs, info, ExitFilter());
+    }
+
+    // то же, но отдает только тех, кого принял accept; остальные остаются в очереди
+    // для следующих waitAny (так JobGraph ждет своих, не отнимая чужих)
+    static bool waitAny(int timeoutMs, ExitInfo& info, const ExitFilter& accept) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        size_t checked = 0; // pending[0..checked) уже отвергнуты фильтром
+
+        for (;;) {
+            for (; checked < pending.size(); checked++) {
+                if (!accept || accept(pending[checked])) {
+                    info = pending[checked];
+                    pending.erase(pending.begin() + checked);
+                    return true;
+                }
+            }
+
+            if (processes.empty()) {
+                return false;
+            }
+
+            int wait = -1;
+            if (timeoutMs >= 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                wait = left > 0 ? static_cast<int>(left) : 0;
+            }
+
+            std::vector<ExitInfo> done;
+            reapReady(wait, done);
+            pending.insert(pending.end(), done.begin(), done.end());
+
+            if (done.empty() && wait == 0) {
+                return false;
+            }
+        }
+    }
+
+    // пожать всех уже завершившихся, не блокируясь
+    static std::vector<ExitInfo> poll() {
+        std::vector<ExitInfo> done(pending.begin(), pending.end());
+        pending.clear();
+        reapReady(0, done);
+        return done;
+    }
+
+    // вызывается на каждого пожатого ребенка (waitAny, poll, waitForAll)
+    static void setExitCallback(ExitCallback callback) {
+        exitCallback = callback;
+    }
+
+    // ставит задачу в очередь, возвращает ее id. Запустится, когда будет свободный слот
+    // (не больше setMaxConcurrency одновременно); результат придет через waitAny/poll/колбэк
+    static int submit(const std::string& program, const std::vector<std::string>& args = {},
+                      int priority = 0, SpawnBackend backend = SpawnBackend::Default) {
+        QueuedJob job;
+        job.id = nextJobId++;
+        job.priority = priority;
+        job.program = program;
+        job.args = args;
+        job.options.backend = backend;
+        jobQueue.push(job);
+
+        dispatchAndPublish();
+        return job.id;
+    }
+
+    // 0 - по числу ядер
+    static void setMaxConcurrency(size_t limit) {
+        maxConcurrency = limit;
+        dispatchAndPublish();
+    }
+
+    static size_t getMaxConcurrency() {
+        return concurrencyLimit();
+    }
+
+    static size_t getQueueDepth() {
+        return jobQueue.size();
+    }
+
+    static size_t getRunningJobs() {
+        return runningJobs;
+    }
+
+    // учет ресурсов: запись на каждого пожатого ребенка (waitAny/poll/waitForAll/launchAndWait)
+    static std::vector<ExitInfo> getUsageRecords() {
+        return std::vector<ExitInfo>(usageRecords.begin(), usageRecords.end());
+    }
+
+    static void clearUsageRecords() {
+        usageRecords.clear();
+    }
+
+    // сколько последних записей держать в памяти, 0 - не держать
+    static void setUsageHistoryLimit(size_t limit) {
+        usageHistoryLimit = limit;
+        while (usageRecords.size() > usageHistoryLimit) {
+            usageRecords.pop_front();
+        }
+    }
+
+    // дописывать записи в файл (CSV с заголовком или JSON lines). Пустой путь - выключить
+    static bool setUsageSink(const std::string& path, UsageFormat format = UsageFormat::Csv) {
+        if (usageSink.is_open()) {
+            usageSink.close();
+        }
+        if (path.empty()) {
+            return true;
+        }
+
+        struct stat st;
+        bool fresh = stat(path.c_str(), &st) != 0 || st.st_size == 0;
+        usageSink.open(path.c_str(), std::ios::app);
+        if (!usageSink.is_open()) {
+            return false;
+        }
+        usageSinkFormat = format;
+        if (format == UsageFormat::Csv && fresh) {
+            usageSink << "pid,program,job,exit,signal,wall_s,user_s,sys_s,max_rss_kb,nvcsw,nivcsw\n";
+        }
+        return true;
+    }
+
+    // launchAndWait с кэшем результатов: stdout/stderr собираются в result целиком.
+    // При options.cacheResult и включенном кэше повтор с тем же ключом отдается с диска без запуска.
+    // Возвращает код выхода (-1 - не запустился или убит сигналом)
+    static int launchAndWait(const std::string& program, const std::vector<std::string>& args,
+                             const LaunchOptions& options, CommandResult& result) {
+        result = CommandResult();
+        std::string key;
+        if (options.cacheResult && !cacheDir.empty()) {
+            key = cacheKey(program, args, options);
+            if (key.empty()) {
+                cacheStats.uncacheable++;
+            } else if (cacheLoad(key, result)) {
+                cacheStats.hits++;
+                return result.exitCode;
+            } else {
+                cacheStats.misses++;
+            }
+        }
+
+        LaunchOptions captured = options;
+        captured.stdoutMode = OutputMode::Callback;
+        captured.stderrMode = OutputMode::Callback;
+        captured.onOutput = [&result](pid_t, int stream, const char* data, size_t size) {
+            (stream == 1 ? result.out : result.err).append(data, size);
+        };
+        bool timedOut = false;
+        pid_t pid = startProcess(program, args, captured, 0);
+        if (pid > 0) {
+            ExitInfo info;
+            if (waitAny(-1, info, [pid](const ExitInfo& e) { return e.pid == pid; })) {
+                result.exitCode = info.exitCode;
+                timedOut = info.timedOut;
+            }
+            // пайп мог остаться открытым у внука - колбэк не должен пережить result
+            discardOutput(pid);
+        }
+
+        // exitCode -1 - сигнал или не запустился: такое не детерминировано, не сохраняем
+        if (!key.empty()) {
+            if (result.exitCode >= 0 && !timedOut) {
+                cacheStore(key, result);
+            } else {
+                cacheStats.uncacheable++;
+            }
+        }
+        return result.exitCode;
+    }
+
+    // включить кэш результатов в каталоге dir с лимитом maxBytes. Пустой dir - выключить
+    static bool setResultCache(const std::string& dir, uint64_t maxBytes = 256ull * 1024 * 1024) {
+        cacheDir.clear();
+        cacheStats.bytes = 0;
+        if (dir.empty()) {
+            return true;
+        }
+
+        // mkdir -p
+        for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+            std::string part = dir.substr(0, pos);
+            if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) {
+                lastError = errno;
+                return false;
+            }
+            if (pos == std::string::npos) {
+                break;
+            }
+        }
+
+        cacheDir = dir;
+        while (cacheDir.size() > 1 && cacheDir[cacheDir.size() - 1] == '/') {
+            cacheDir.erase(cacheDir.size() - 1);
+        }
+        cacheMaxBytes = maxBytes;
+        trimCache();
+        return true;
+    }
+
+    // кэш путей к программам (включен по умолчанию). Выключение сразу все забывает
+    static void setPathCache(bool enabled) {
+        pathCacheEnabled = enabled;
+        clearPathCache();
+    }
+
+    static void clearPathCache() {
+        pathCache.clear();
+        pathCacheValid = false;
+        if (pathWatchFd >= 0) {
+            close(pathWatchFd);
+            pathWatchFd = -1;
+        }
+    }
+
+    static PathCacheStats getPathCacheStats() {
+        return pathCacheStats;
+    }
+
+    static CacheStats getCacheStats() {
+        return cacheStats;
+    }
+
+    static void resetCacheStats() {
+        uint64_t bytes = cacheStats.bytes;
+        cacheStats = CacheStats();
+        cacheStats.bytes = bytes;
+    }
+#endif
+    
+    // Запросы ниже только смотрят: на юниксе завершившиеся остаются в реестре
+    // (и не пожинаются), пока их не заберет waitAny/poll
+    static size_t getRunningCount() { //колво запущенных процессов
+#ifdef _WIN32
+        pruneExited();
+        return processes.size();
+#else
+        size_t count = 0;
+        for (const auto& entry : processes) {
+            count += isAlive(entry.second.pid);
+        }
+        return count;
+#endif
+    }
+    
+    static std::vector<std::string> getRunningPrograms() { //инфа о запущенных процессах
+#ifdef _WIN32
+        pruneExited();
+#endif
+        std::vector<std::string> result;
+        result.reserve(processes.size());
+        for (const auto& entry : processes) {
+#ifndef _WIN32
+            if (!isAlive(entry.second.pid)) {
+                continue;
+            }
+#endif
+            result.push_back(entry.second.program);
+        }
+        return result;
+    }
+    
+    // точное имя ищется по индексу; иначе, как и раньше, подстрока - но только
+    // среди различных имен программ, а не по всем процессам
+    static bool isProgramRunning(const std::string& program) {
+#ifdef _WIN32
+        pruneExited();
+#endif
+        bool candidate = programIndex.find(program) != programIndex.end();
+        for (auto it = programIndex.begin(); !candidate && it != programIndex.end(); ++it) {
+            candidate = it->first.find(program) != std::string::npos;
+        }
+#ifndef _WIN32
+        // имя есть в реестре - осталось убедиться, что хоть один такой еще не вышел
+        for (auto it = processes.begin(); candidate && it != processes.end(); ++it) {
+            if (it->second.program.find(program) != std::string::npos && isAlive(it->second.pid)) {
+                return true;
+            }
+        }
+        return false;
+#else
+        return candidate;
+#endif
+    }
+};
+
+std::unordered_map<BackgroundLauncher::ProcessId, BackgroundLauncher::ProcessInfo> BackgroundLauncher::processes;
+std::unordered_map<std::string, size_t> BackgroundLauncher::programIndex;
+BackgroundLauncher::SpawnBackend BackgroundLauncher::defaultBackend = BackgroundLauncher::SpawnBackend::PosixSpawn;
+int BackgroundLauncher::lastError = 0;
+#ifndef _WIN32
+int BackgroundLauncher::epollFd = -1;
+int BackgroundLauncher::sigchldFd = -1;
+bool BackgroundLauncher::sigchldBlocked = false;
+sigset_t BackgroundLauncher::savedSigmask;
+bool BackgroundLauncher::needScan = false;
+std::unordered_set<pid_t> BackgroundLauncher::unwatched;
+std::deque<BackgroundLauncher::ExitInfo> BackgroundLauncher::pending;
+BackgroundLauncher::ExitCallback BackgroundLauncher::exitCallback;
+std::priority_queue<BackgroundLauncher::QueuedJob> BackgroundLauncher::jobQueue;
+size_t BackgroundLauncher::maxConcurrency = 0;
+size_t BackgroundLauncher::runningJobs = 0;
+int BackgroundLauncher::nextJobId = 1;
+std::unordered_map<pid_t, BackgroundLauncher::ProcessOutput> BackgroundLauncher::outputs;
+pid_t BackgroundLauncher::zygotePid = -1;
+int BackgroundLauncher::zygoteSock = -1;
+bool BackgroundLauncher::batchActive = false;
+std::chrono::steady_clock::time_point BackgroundLauncher::batchDeadline;
+int BackgroundLauncher::batchGraceMs = 2000;
+std::deque<BackgroundLauncher::ExitInfo> BackgroundLauncher::usageRecords;
+size_t BackgroundLauncher::usageHistoryLimit = 4096;
+std::ofstream BackgroundLauncher::usageSink;
+BackgroundLauncher::UsageFormat BackgroundLauncher::usageSinkFormat = BackgroundLauncher::UsageFormat::Csv;
+std::string BackgroundLauncher::cacheDir;
+uint64_t BackgroundLauncher::cacheMaxBytes = 0;
+BackgroundLauncher::CacheStats BackgroundLauncher::cacheStats;
+unsigned BackgroundLauncher::cacheTmpCounter = 0;
+bool BackgroundLauncher::pathCacheEnabled = true;
+bool BackgroundLauncher::pathCacheValid = false;
+std::string BackgroundLauncher::pathCacheEnv;
+std::unordered_map<std::string, std::string> BackgroundLauncher::pathCache;
+int BackgroundLauncher::pathWatchFd = -1;
+BackgroundLauncher::PathCacheStats BackgroundLauncher::pathCacheStats;
+unsigned BackgroundLauncher::placementCursor = 0;
+std::vector<std::vector<int>> BackgroundLauncher::numaNodes;
+bool BackgroundLauncher::numaLoaded = false;
+#endif
 
 #endif // BACKGROUND_LAUNCHER_HPP
\ No newline at end of file
@@ -0,0 +1,519 @@
+// Бенчмарк запуска процессов через BackgroundLauncher.
+// Для каждой комбинации (бэкенд, RSS родителя, параллельность) печатает строку JSON:
+//   spawn_*  - сколько длится launch: все бэкенды возвращаются только после exec,
+//              так что это и есть задержка spawn -> exec
+//   reap_*   - от момента выхода ребенка (он сам печатает CLOCK_MONOTONIC) до его пожатия
+//   launches_per_sec - пропускная способность при заданном числе одновременных детей
+// С --threads вместо этого гоняет ConcurrentLauncher из нескольких потоков (стресс):
+//   lost / double_reaped - pid, которые так и не пожали или отдали дважды (должно быть 0),
+//   forks - сколько раз сторонний поток сделал fork посреди этого и ребенок не завис на локах
+// Плюс случай path_resolution: запуск по имени, которое лежит в последнем из --path-dirs
+// каталогов PATH, с кэшем путей и без (без кэша ребенок пробует execve в каждом каталоге).
+//   failed_execve_per_launch - неудачные execve на запуск, посчитанные через ptrace
+//              в отдельном прогоне (null, если ptrace здесь запрещен)
+//
+// ./LAB2_BENCH [--launches N] [--rss 10,1024,4096] [--concurrency 1,4,16]
+//              [--backends fork,vfork,posix_spawn,zygote] [--threads 1,4,16] [--path-dirs 16]
+#include "back.hpp"
+#include "concurrent_launcher.hpp"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <atomic>
+#include <map>
+
+#ifdef _WIN32
+int main() {
+    std::cerr << "Benchmark is available on UNIX only" << std::endl;
+    return 1;
+}
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+static long long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> result;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+static bool parseBackend(const std::string& name, BackgroundLauncher::SpawnBackend& backend) {
+    if (name == "fork") {
+        backend = BackgroundLauncher::SpawnBackend::Fork;
+    } else if (name == "vfork") {
+        backend = BackgroundLauncher::SpawnBackend::VFork;
+    } else if (name == "posix_spawn") {
+        backend = BackgroundLauncher::SpawnBackend::PosixSpawn;
+    } else if (name == "zygote") {
+        backend = BackgroundLauncher::SpawnBackend::Zygote;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// раздуваем родителя до нужного RSS: страницы именно трогаем, а не только выделяем
+static void* growRss(size_t mb) {
+    if (mb == 0) {
+        return nullptr;
+    }
+    size_t size = mb * 1024 * 1024;
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return nullptr;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < size; off += page) {
+        static_cast<char*>(mem)[off] = 1;
+    }
+    return mem;
+}
+
+static void printStats(std::ostream& out, const char* name, const std::vector<double>& us) {
+    out << ",\"" << name << "_p50_us\":" << percentile(us, 0.50)
+        << ",\"" << name << "_p90_us\":" << percentile(us, 0.90)
+        << ",\"" << name << "_p99_us\":" << percentile(us, 0.99)
+        << ",\"" << name << "_max_us\":" << percentile(us, 1.0);
+}
+
+static void runCase(const std::string& self, const std::string& backendName,
+                    BackgroundLauncher::SpawnBackend backend, size_t rssMb,
+                    size_t concurrency, size_t launches) {
+    BackgroundLauncher::LaunchOptions options;
+    options.backend = backend;
+    options.stdoutMode = BackgroundLauncher::OutputMode::RingBuffer;
+    options.ringCapacity = 64;
+
+    std::vector<double> spawnUs;
+    std::vector<double> reapUs;
+    spawnUs.reserve(launches);
+    reapUs.reserve(launches);
+
+    // время пожатия снимаем в колбэке, он зовется в момент пожатия
+    BackgroundLauncher::setExitCallback([&reapUs](const BackgroundLauncher::ExitInfo& info) {
+        long long reaped = monotonicNs();
+        std::string stamp = BackgroundLauncher::takeOutput(info.pid, 1);
+        long long exited = atoll(stamp.c_str());
+        if (exited > 0 && reaped >= exited) {
+            reapUs.push_back((reaped - exited) / 1000.0);
+        }
+    });
+
+    size_t started = 0;
+    size_t failed = 0;
+    size_t reaped = 0;
+    long long begin = monotonicNs();
+
+    // слоты считаем сами, до пожатия: getRunningCount не пожинает, и вышедший, но не
+    // отданный waitAny ребенок освобождал бы слот раньше, чем мы его увидели
+    while (started < launches || reaped + failed < started) {
+        while (started < launches && started - failed - reaped < concurrency) {
+            long long t0 = monotonicNs();
+            pid_t pid = BackgroundLauncher::spawn(self, {"--stamp"}, options);
+            long long t1 = monotonicNs();
+            started++;
+            if (pid < 0) {
+                failed++;
+                continue;
+            }
+            spawnUs.push_back((t1 - t0) / 1000.0);
+        }
+
+        // дождаться одного и забрать всех уже вышедших, пока не запустили новых
+        BackgroundLauncher::ExitInfo info;
+        for (int timeout = -1; BackgroundLauncher::waitAny(timeout, info); timeout = 0) {
+            reaped++;
+        }
+    }
+
+    double seconds = (monotonicNs() - begin) / 1e9;
+    BackgroundLauncher::setExitCallback(nullptr);
+    BackgroundLauncher::clearUsageRecords();
+
+    std::ostringstream line;
+    line << "{\"backend\":\"" << backendName << "\""
+         << ",\"rss_mb\":" << rssMb
+         << ",\"concurrency\":" << concurrency
+         << ",\"launches\":" << launches
+         << ",\"failed\":" << failed
+         << ",\"launches_per_sec\":" << (seconds > 0 ? (launches - failed) / seconds : 0);
+    printStats(line, "spawn", spawnUs);
+    printStats(line, "reap", reapUs);
+    line << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runStress(const std::string& self, size_t threads, size_t launches) {
+    ConcurrentLauncher launcher;
+    std::vector<std::vector<pid_t>> launched(threads);
+    std::vector<std::vector<pid_t>> reaped(threads);
+    std::atomic<size_t> failed(0);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> forks(0);
+
+    // fork посреди запусков: ребенок заводит свой launcher (общий instancesMutex) и запускает
+    // через него. Без atfork-обработчиков он мог бы навсегда повиснуть на чужом мьютексе.
+    // Унаследованным launcher пользоваться нельзя: его epoll и eventfd общие с родителем
+    std::thread forker([&]() {
+        while (!stop.load()) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                {
+                    ConcurrentLauncher own(1);
+                    own.launch(self, {"--noop"});
+                }
+                _exit(0);
+            }
+            if (pid > 0) {
+                int status;
+                waitpid(pid, &status, 0);
+                forks++;
+            }
+            usleep(1000);
+        }
+    });
+
+    long long begin = monotonicNs();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            size_t share = launches / threads + (t < launches % threads ? 1 : 0);
+            for (size_t i = 0; i < share; i++) {
+                pid_t pid = launcher.launch(self, {"--noop"});
+                if (pid < 0) {
+                    failed++;
+                    continue;
+                }
+                launched[t].push_back(pid);
+                // пожать кого угодно, не обязательно своего
+                ConcurrentLauncher::ExitInfo info;
+                if (launcher.waitAny(-1, info)) {
+                    reaped[t].push_back(info.pid);
+                }
+            }
+            ConcurrentLauncher::ExitInfo info;
+            while (launcher.waitAny(-1, info)) {
+                reaped[t].push_back(info.pid);
+            }
+        }));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = (monotonicNs() - begin) / 1e9;
+    stop = true;
+    forker.join();
+
+    std::map<pid_t, int> balance; // +1 за запуск, -1 за пожатие
+    size_t total = 0;
+    for (size_t t = 0; t < threads; t++) {
+        for (pid_t pid : launched[t]) {
+            balance[pid]++;
+            total++;
+        }
+        for (pid_t pid : reaped[t]) {
+            balance[pid]--;
+        }
+    }
+    size_t lost = 0;
+    size_t doubled = 0;
+    for (const auto& entry : balance) {
+        if (entry.second > 0) {
+            lost += entry.second;
+        } else if (entry.second < 0) {
+            doubled += -entry.second;
+        }
+    }
+
+    std::cout << "{\"case\":\"concurrent\",\"threads\":" << threads
+              << ",\"launches\":" << total
+              << ",\"failed\":" << failed.load()
+              << ",\"lost\":" << lost
+              << ",\"double_reaped\":" << doubled
+              << ",\"forks\":" << forks.load()
+              << ",\"launches_per_sec\":" << (seconds > 0 ? total / seconds : 0)
+              << "}" << std::endl;
+}
+
+// --path-probe: n запусков lab2-bench-child по PATH, под трассировкой countFailedExecs
+static int runPathProbe(bool cached, size_t launches) {
+    BackgroundLauncher::setPathCache(cached);
+    BackgroundLauncher::LaunchOptions options;
+    options.backend = BackgroundLauncher::SpawnBackend::PosixSpawn;
+    for (size_t i = 0; i < launches; i++) {
+        pid_t pid = BackgroundLauncher::spawn("lab2-bench-child", {"--noop"}, options);
+        if (pid < 0) {
+            return 1;
+        }
+        BackgroundLauncher::ExitInfo info;
+        BackgroundLauncher::waitAny(-1, info, [pid](const BackgroundLauncher::ExitInfo& e) { return e.pid == pid; });
+    }
+    return 0;
+}
+
+// Запускает --path-probe под ptrace (со всеми потомками) и считает execve, вернувшие ошибку.
+// Трассировка сильно тормозит, поэтому это отдельный прогон, без замеров времени. -1 - не вышло
+static long countFailedExecs(const std::string& self, bool cached, size_t launches) {
+    std::string count = std::to_string(launches);
+    pid_t root = fork();
+    if (root == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0) {
+            _exit(126);
+        }
+        execl(self.c_str(), self.c_str(), "--path-probe", cached ? "1" : "0", count.c_str(),
+              static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    if (root < 0) {
+        return -1;
+    }
+
+    int status;
+    if (waitpid(root, &status, 0) != root || !WIFSTOPPED(status)) {
+        return -1; // ptrace запрещен - ребенок уже вышел
+    }
+    ptrace(PTRACE_SETOPTIONS, root, nullptr,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+           PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, root, nullptr, nullptr);
+
+    std::map<pid_t, uint64_t> syscallNr; // какой вызов сейчас делает каждый трассируемый
+    long failed = 0;
+    bool ok = false;
+    for (;;) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            syscallNr.erase(pid);
+            if (pid == root) {
+                ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                break;
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(status)) {
+            continue;
+        }
+
+        int sig = WSTOPSIG(status);
+        if (sig == (SIGTRAP | 0x80)) {
+            __ptrace_syscall_info info;
+            memset(&info, 0, sizeof(info));
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) > 0) {
+                if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                    syscallNr[pid] = info.entry.nr;
+                } else if (info.op == PTRACE_SYSCALL_INFO_EXIT) {
+                    if (syscallNr[pid] == SYS_execve && info.exit.is_error) {
+                        failed++;
+                    }
+                }
+            }
+            sig = 0;
+        } else if (sig == SIGTRAP || sig == SIGSTOP) {
+            sig = 0; // события fork/clone/exec и стартовая остановка новых потомков
+        }
+        ptrace(PTRACE_SYSCALL, pid, nullptr, reinterpret_cast<void*>(static_cast<long>(sig)));
+    }
+    return ok ? failed : -1;
+}
+
+static void runPathCase(const std::string& self, size_t dirs, size_t launches) {
+    std::string root = "/tmp/lab2_bench_path_" + std::to_string(getpid());
+    std::string path;
+    mkdir(root.c_str(), 0755);
+    for (size_t i = 0; i < dirs; i++) {
+        std::string dir = root + "/d" + std::to_string(i);
+        mkdir(dir.c_str(), 0755);
+        path += dir + ":";
+    }
+    std::string bin = root + "/bin";
+    std::string child = bin + "/lab2-bench-child";
+    mkdir(bin.c_str(), 0755);
+    if (symlink(self.c_str(), child.c_str()) != 0) {
+        std::cerr << "Cannot create " << child << std::endl;
+        return;
+    }
+    path += bin;
+
+    const char* saved = getenv("PATH");
+    std::string savedPath = saved != nullptr ? saved : "";
+    setenv("PATH", path.c_str(), 1);
+
+    BackgroundLauncher::LaunchOptions options;
+    options.backend = BackgroundLauncher::SpawnBackend::PosixSpawn;
+    for (int cached = 0; cached < 2; cached++) {
+        BackgroundLauncher::setPathCache(cached != 0);
+        std::vector<double> spawnUs;
+        size_t failed = 0;
+        for (size_t i = 0; i < launches; i++) {
+            long long t0 = monotonicNs();
+            pid_t pid = BackgroundLauncher::spawn("lab2-bench-child", {"--noop"}, options);
+            long long t1 = monotonicNs();
+            if (pid < 0) {
+                failed++;
+                continue;
+            }
+            spawnUs.push_back((t1 - t0) / 1000.0);
+            BackgroundLauncher::ExitInfo info;
+            BackgroundLauncher::waitAny(-1, info, [pid](const BackgroundLauncher::ExitInfo& e) { return e.pid == pid; });
+        }
+        BackgroundLauncher::clearUsageRecords();
+
+        size_t traced = std::min<size_t>(launches, 50);
+        long failedExecs = countFailedExecs(self, cached != 0, traced);
+
+        std::ostringstream line;
+        line << "{\"case\":\"path_resolution\",\"path_dirs\":" << dirs
+             << ",\"path_cache\":" << (cached ? "true" : "false")
+             << ",\"launches\":" << launches
+             << ",\"failed\":" << failed
+             << ",\"failed_execve_per_launch\":";
+        if (failedExecs < 0) {
+            line << "null";
+        } else {
+            line << static_cast<double>(failedExecs) / traced;
+        }
+        printStats(line, "spawn", spawnUs);
+        line << "}";
+        std::cout << line.str() << std::endl;
+    }
+
+    BackgroundLauncher::setPathCache(true);
+    setenv("PATH", savedPath.c_str(), 1);
+    unlink(child.c_str());
+    rmdir(bin.c_str());
+    for (size_t i = 0; i < dirs; i++) {
+        rmdir((root + "/d" + std::to_string(i)).c_str());
+    }
+    rmdir(root.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    // режим ребенка: отметить момент выхода и сразу выйти
+    if (argc > 1 && strcmp(argv[1], "--stamp") == 0) {
+        printf("%lld\n", monotonicNs());
+        fflush(stdout);
+        _exit(0);
+    }
+    if (argc > 1 && strcmp(argv[1], "--noop") == 0) {
+        _exit(0);
+    }
+    if (argc > 3 && strcmp(argv[1], "--path-probe") == 0) {
+        return runPathProbe(strcmp(argv[2], "1") == 0, static_cast<size_t>(atol(argv[3])));
+    }
+
+    // зигота форкается, пока мы еще маленькие
+    BackgroundLauncher::startZygote();
+
+    size_t launches = 200;
+    std::string rssList = "10,1024";
+    std::string concurrencyList = "1,4,16";
+    std::string backendList = "fork,vfork,posix_spawn,zygote";
+    std::string threadList;
+    size_t pathDirs = 16;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "--launches") {
+            launches = static_cast<size_t>(atol(argv[i + 1]));
+        } else if (opt == "--rss") {
+            rssList = argv[i + 1];
+        } else if (opt == "--concurrency") {
+            concurrencyList = argv[i + 1];
+        } else if (opt == "--backends") {
+            backendList = argv[i + 1];
+        } else if (opt == "--threads") {
+            threadList = argv[i + 1];
+        } else if (opt == "--path-dirs") {
+            pathDirs = static_cast<size_t>(atol(argv[i + 1]));
+        } else {
+            std::cerr << "Unknown option: " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    char selfPath[4096];
+    ssize_t len = readlink("/proc/self/exe", selfPath, sizeof(selfPath) - 1);
+    if (len <= 0) {
+        std::cerr << "Cannot resolve /proc/self/exe" << std::endl;
+        return 1;
+    }
+    selfPath[len] = '\0';
+
+    if (!threadList.empty()) {
+        for (const auto& t : splitList(threadList)) {
+            runStress(selfPath, std::max<size_t>(1, static_cast<size_t>(atol(t.c_str()))), launches);
+        }
+        BackgroundLauncher::stopZygote();
+        return 0;
+    }
+
+    size_t currentRss = 0;
+    for (const auto& rss : splitList(rssList)) {
+        size_t mb = static_cast<size_t>(atol(rss.c_str()));
+        // память только добавляем, поэтому список RSS лучше давать по возрастанию
+        if (mb > currentRss) {
+            if (growRss(mb - currentRss) == nullptr) {
+                std::cerr << "Cannot grow RSS to " << mb << " MB" << std::endl;
+                continue;
+            }
+            currentRss = mb;
+        }
+
+        for (const auto& backendName : splitList(backendList)) {
+            BackgroundLauncher::SpawnBackend backend;
+            if (!parseBackend(backendName, backend)) {
+                std::cerr << "Unknown backend: " << backendName << std::endl;
+                continue;
+            }
+            for (const auto& c : splitList(concurrencyList)) {
+                size_t concurrency = std::max<size_t>(1, static_cast<size_t>(atol(c.c_str())));
+                runCase(selfPath, backendName, backend, currentRss, concurrency, launches);
+            }
+        }
+    }
+
+    if (pathDirs > 0) {
+        runPathCase(selfPath, pathDirs, launches);
+    }
+
+    BackgroundLauncher::stopZygote();
+    return 0;
+}
+#endif
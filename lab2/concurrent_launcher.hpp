@@ -0,0 +1,351 @@
+#ifndef CONCURRENT_LAUNCHER_HPP
+#define CONCURRENT_LAUNCHER_HPP
+
+#include "back.hpp"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/eventfd.h>
+
+// Лаунчер-экземпляр для многопоточного хозяина: launch и waitAny можно звать из любых потоков.
+// Реестр разбит на шарды по pid, у каждого свой мьютекс, так что потоки почти не встречаются.
+// Каждого ребенка ждем через pidfd в общем epoll с EPOLLONESHOT: событие получает ровно
+// один поток, он же делает wait4 и снимает запись - ни потерь, ни двойного реапинга.
+// Вывод не перехватывается, зигота не используется (у нее один сокет на всех)
+class ConcurrentLauncher {
+public:
+    typedef BackgroundLauncher::ExitInfo ExitInfo;
+    typedef BackgroundLauncher::SpawnBackend SpawnBackend;
+
+    // shards 0 - по 4 на ядро
+    explicit ConcurrentLauncher(size_t shards = 0)
+        : _epollFd(-1), _idleFd(-1), _running(0), _unwatched(0) {
+        if (shards == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            shards = 4 * static_cast<size_t>(cores > 0 ? cores : 1);
+        }
+        _shardCount = shards;
+        _shards.reset(new Shard[shards]);
+        _epollFd = epoll_create1(EPOLL_CLOEXEC);
+        _idleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_epollFd >= 0 && _idleFd >= 0) {
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = IdleTag;
+            epoll_ctl(_epollFd, EPOLL_CTL_ADD, _idleFd, &ev);
+        }
+
+        std::call_once(atforkOnce, []() {
+            pthread_atfork(atforkPrepare, atforkParent, atforkChild);
+        });
+        std::lock_guard<std::mutex> lock(instancesMutex);
+        instances.push_back(this);
+    }
+
+    ConcurrentLauncher(const ConcurrentLauncher&) = delete;
+    ConcurrentLauncher& operator=(const ConcurrentLauncher&) = delete;
+
+    // дожидается всех своих детей, чтобы не оставить зомби
+    ~ConcurrentLauncher() {
+        waitForAll();
+        {
+            std::lock_guard<std::mutex> lock(instancesMutex);
+            instances.erase(std::remove(instances.begin(), instances.end(), this), instances.end());
+        }
+        if (_epollFd >= 0) {
+            close(_epollFd);
+        }
+        if (_idleFd >= 0) {
+            close(_idleFd);
+        }
+    }
+
+    // pid или -1 (причина - getLastError, своя у каждого потока)
+    pid_t launch(const std::string& program, const std::vector<std::string>& args = {},
+                 SpawnBackend backend = SpawnBackend::Default) {
+        if (_epollFd < 0) {
+            lastError = EMFILE;
+            return -1;
+        }
+        if (backend == SpawnBackend::Default) {
+            backend = BackgroundLauncher::defaultBackend;
+        }
+
+        std::vector<char*> argv = BackgroundLauncher::buildArgv(program, args);
+        std::vector<char*> envp = BackgroundLauncher::buildEnvp(nullptr);
+        int err = 0;
+        pid_t pid;
+        // fork/vfork/posix_spawn сами по себе потокобезопасны; пайпы и fd у нас с O_CLOEXEC.
+        // Кэш путей у BackgroundLauncher однопоточный, поэтому здесь PATH ищет сам exec
+        switch (backend) {
+        case SpawnBackend::Fork:
+            pid = BackgroundLauncher::spawnFork(argv[0], argv.data(), envp.data(), nullptr, nullptr, err);
+            break;
+        case SpawnBackend::VFork:
+            pid = BackgroundLauncher::spawnVFork(argv[0], argv.data(), envp.data(), nullptr, nullptr, err);
+            break;
+        default:
+            pid = BackgroundLauncher::spawnPosix(argv[0], argv.data(), envp.data(), nullptr, err);
+            break;
+        }
+        if (pid < 0) {
+            lastError = err;
+            return -1;
+        }
+
+        Entry entry;
+        entry.program = program;
+        entry.pidfd = BackgroundLauncher::openPidfd(pid);
+        entry.started = std::chrono::steady_clock::now();
+
+        // сначала в реестр, потом в epoll: поток, поймавший событие, запись уже найдет
+        onLaunched();
+        {
+            Shard& shard = shardOf(pid);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.processes[pid] = entry;
+        }
+        if (entry.pidfd >= 0) {
+            epoll_event ev;
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.u64 = static_cast<uint32_t>(pid);
+            epoll_ctl(_epollFd, EPOLL_CTL_ADD, entry.pidfd, &ev);
+        } else {
+            _unwatched.fetch_add(1);
+        }
+        return pid;
+    }
+
+    // ждет любого своего ребенка, timeoutMs < 0 - без таймаута.
+    // false - таймаут или ждать некого (в том числе если последнего забрал другой поток)
+    bool waitAny(int timeoutMs, ExitInfo& info) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+        for (;;) {
+            if (_running.load() == 0) {
+                return false;
+            }
+
+            int wait = -1;
+            if (timeoutMs >= 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                wait = left > 0 ? static_cast<int>(left) : 0;
+            }
+            // без pidfd остается опрос через WNOHANG
+            bool blind = _unwatched.load() > 0;
+            if (blind && (wait < 0 || wait > 10)) {
+                wait = 10;
+            }
+
+            // по одному событию за раз: EPOLLONESHOT отдает pidfd ровно одному потоку
+            epoll_event ev;
+            int n = epoll_wait(_epollFd, &ev, 1, wait);
+            if (n == 1 && ev.data.u64 != IdleTag && reap(static_cast<pid_t>(ev.data.u64), info)) {
+                return true;
+            }
+            if (blind && scanUnwatched(info)) {
+                return true;
+            }
+
+            if (timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+    }
+
+    size_t waitForAll() {
+        size_t count = 0;
+        ExitInfo info;
+        while (waitAny(-1, info)) {
+            count++;
+        }
+        return count;
+    }
+
+    size_t getRunningCount() const {
+        return _running.load();
+    }
+
+    static int getLastError() {
+        return lastError;
+    }
+
+private:
+    struct Entry {
+        std::string program;
+        int pidfd;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    // шард на свою кэш-линию, чтобы соседние мьютексы не делили ее между ядрами
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<pid_t, Entry> processes;
+        char pad[64];
+    };
+
+    enum : uint64_t { IdleTag = ~0ull }; // eventfd "детей не осталось"
+
+    int _epollFd;
+    int _idleFd;
+    size_t _shardCount;
+    std::unique_ptr<Shard[]> _shards;
+    std::atomic<size_t> _running;
+    std::atomic<size_t> _unwatched; // процессы без pidfd
+    std::mutex _idleMutex;
+
+    static thread_local int lastError;
+    static std::mutex instancesMutex;
+    static std::vector<ConcurrentLauncher*> instances;
+    static std::once_flag atforkOnce;
+
+    Shard& shardOf(pid_t pid) {
+        return _shards[static_cast<size_t>(pid) % _shardCount];
+    }
+
+    // idleFd взведен, пока детей нет: иначе ждущие в epoll_wait(-1) не узнают,
+    // что последнего ребенка забрал другой поток. Переходы через ноль - под _idleMutex
+    void onLaunched() {
+        if (_running.fetch_add(1) == 0) {
+            std::lock_guard<std::mutex> lock(_idleMutex);
+            if (_running.load() > 0) {
+                uint64_t value;
+                ssize_t unused = read(_idleFd, &value, sizeof(value));
+                (void)unused;
+            }
+        }
+    }
+
+    void onReaped() {
+        if (_running.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(_idleMutex);
+            if (_running.load() == 0) {
+                uint64_t one = 1;
+                ssize_t unused = write(_idleFd, &one, sizeof(one));
+                (void)unused;
+            }
+        }
+    }
+
+    bool reap(pid_t pid, ExitInfo& info) {
+        Shard& shard = shardOf(pid);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto it = shard.processes.find(pid);
+        if (it == shard.processes.end()) {
+            return false;
+        }
+        if (!finish(it, info)) {
+            // событие без завершения - взводим pidfd заново
+            epoll_event ev;
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.u64 = static_cast<uint32_t>(pid);
+            epoll_ctl(_epollFd, EPOLL_CTL_MOD, it->second.pidfd, &ev);
+            return false;
+        }
+        shard.processes.erase(it);
+        lock.unlock();
+        onReaped();
+        return true;
+    }
+
+    bool scanUnwatched(ExitInfo& info) {
+        for (size_t i = 0; i < _shardCount; i++) {
+            Shard& shard = _shards[i];
+            // занятый шард пропускаем: его просмотрит другой поток или следующий проход
+            std::unique_lock<std::mutex> lock(shard.mutex, std::try_to_lock);
+            if (!lock.owns_lock()) {
+                continue;
+            }
+            for (auto it = shard.processes.begin(); it != shard.processes.end(); ++it) {
+                if (it->second.pidfd >= 0 || !finish(it, info)) {
+                    continue;
+                }
+                shard.processes.erase(it);
+                lock.unlock();
+                _unwatched.fetch_sub(1);
+                onReaped();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // wait4 под локом шарда: pid снимается с учета тем же потоком, что его пожал
+    bool finish(std::unordered_map<pid_t, Entry>::iterator it, ExitInfo& info) {
+        int status = 0;
+        struct rusage usage;
+        memset(&usage, 0, sizeof(usage));
+        pid_t r;
+        do {
+            r = wait4(it->first, &status, WNOHANG, &usage);
+        } while (r < 0 && errno == EINTR);
+        if (r == 0) {
+            return false;
+        }
+
+        info = ExitInfo();
+        info.pid = it->first;
+        info.program = it->second.program;
+        info.wallSeconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - it->second.started).count();
+        info.userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        info.sysSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        info.maxRssKb = BackgroundLauncher::childPeakRss(usage);
+        info.voluntarySwitches = usage.ru_nvcsw;
+        info.involuntarySwitches = usage.ru_nivcsw;
+        BackgroundLauncher::fillExitInfo(info, status, r == it->first);
+        if (it->second.pidfd >= 0) {
+            close(it->second.pidfd); // из epoll уйдет сам
+        }
+        return true;
+    }
+
+    // fork из чужого потока, пока кто-то держит мьютекс шарда, оставил бы ребенку
+    // навсегда запертый мьютекс. Перед fork забираем все локи, после - отпускаем в обоих
+    static void atforkPrepare() {
+        instancesMutex.lock();
+        for (ConcurrentLauncher* inst : instances) {
+            inst->_idleMutex.lock();
+            for (size_t i = 0; i < inst->_shardCount; i++) {
+                inst->_shards[i].mutex.lock();
+            }
+        }
+    }
+
+    static void atforkRelease() {
+        for (auto rit = instances.rbegin(); rit != instances.rend(); ++rit) {
+            ConcurrentLauncher* inst = *rit;
+            for (size_t i = inst->_shardCount; i > 0; i--) {
+                inst->_shards[i - 1].mutex.unlock();
+            }
+            inst->_idleMutex.unlock();
+        }
+        instancesMutex.unlock();
+    }
+
+    static void atforkParent() {
+        atforkRelease();
+    }
+
+    // в ребенке реестр - копия чужих детей: пользоваться им там нельзя, но и виснуть не на чем
+    static void atforkChild() {
+        atforkRelease();
+    }
+};
+
+thread_local int ConcurrentLauncher::lastError = 0;
+std::mutex ConcurrentLauncher::instancesMutex;
+std::vector<ConcurrentLauncher*> ConcurrentLauncher::instances;
+std::once_flag ConcurrentLauncher::atforkOnce;
+
+#endif // _WIN32
+
+#endif // CONCURRENT_LAUNCHER_HPP
@@ -0,0 +1,238 @@
+#ifndef JOB_GRAPH_HPP
+#define JOB_GRAPH_HPP
+
+#include "back.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <unordered_map>
+
+#ifndef _WIN32
+
+// Граф задач поверх BackgroundLauncher: задача стартует, когда все ее зависимости
+// завершились с кодом 0; независимые ветки идут параллельно (не больше maxConcurrency).
+// Упавшая задача отменяет все, что от нее зависит, остальные ветки доезжают.
+class JobGraph {
+public:
+    enum class State {
+        Pending,
+        Running,
+        Succeeded,
+        Failed,
+        Cancelled  // не запускалась: упала одна из зависимостей
+    };
+
+    struct Node {
+        std::string name;
+        std::string program;
+        std::vector<std::string> args;
+        std::vector<int> deps;
+        BackgroundLauncher::LaunchOptions options;
+
+        State state;
+        int exitCode;
+        pid_t pid;
+        double startSeconds;  // от начала run()
+        double finishSeconds;
+    };
+
+    // deps - id уже добавленных задач, так что цикл собрать нельзя. Возвращает id или -1
+    int add(const std::string& name, const std::string& program,
+            const std::vector<std::string>& args = {}, const std::vector<int>& deps = {},
+            const BackgroundLauncher::LaunchOptions& options = BackgroundLauncher::LaunchOptions()) {
+        int id = static_cast<int>(_nodes.size());
+        for (int dep : deps) {
+            if (dep < 0 || dep >= id) {
+                return -1;
+            }
+        }
+
+        Node node;
+        node.name = name;
+        node.program = program;
+        node.args = args;
+        node.deps = deps;
+        node.options = options;
+        node.state = State::Pending;
+        node.exitCode = -1;
+        node.pid = -1;
+        node.startSeconds = 0;
+        node.finishSeconds = 0;
+        _nodes.push_back(node);
+
+        _dependents.push_back(std::vector<int>());
+        for (int dep : deps) {
+            _dependents[dep].push_back(id);
+        }
+        return id;
+    }
+
+    // выполнить граф, блокируясь до конца. maxConcurrency 0 - по числу ядер.
+    // true, если все задачи завершились успешно
+    bool run(size_t maxConcurrency = 0) {
+        if (maxConcurrency == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            maxConcurrency = cores > 0 ? static_cast<size_t>(cores) : 1;
+        }
+
+        _start = std::chrono::steady_clock::now();
+        _byPid.clear();
+
+        std::vector<size_t> waitingFor(_nodes.size());
+        std::deque<int> ready;
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            Node& node = _nodes[i];
+            node.state = State::Pending;
+            node.exitCode = -1;
+            node.pid = -1;
+            waitingFor[i] = node.deps.size();
+            if (waitingFor[i] == 0) {
+                ready.push_back(static_cast<int>(i));
+            }
+        }
+
+        size_t running = 0;
+        bool ok = true;
+
+        while (!ready.empty() || running > 0) {
+            while (!ready.empty() && running < maxConcurrency) {
+                int id = ready.front();
+                ready.pop_front();
+                Node& node = _nodes[id];
+
+                node.startSeconds = elapsed();
+                node.pid = BackgroundLauncher::spawn(node.program, node.args, node.options);
+                if (node.pid < 0) {
+                    node.finishSeconds = node.startSeconds;
+                    node.state = State::Failed;
+                    ok = false;
+                    cancelDependents(id);
+                    continue;
+                }
+                node.state = State::Running;
+                _byPid[node.pid] = id;
+                running++;
+            }
+
+            if (running == 0) {
+                continue;
+            }
+
+            BackgroundLauncher::ExitInfo info;
+            bool got = BackgroundLauncher::waitAny(-1, info, [this](const BackgroundLauncher::ExitInfo& e) {
+                return _byPid.find(e.pid) != _byPid.end();
+            });
+            if (!got) {
+                break; // наших процессов в реестре больше нет - ждать нечего
+            }
+
+            auto it = _byPid.find(info.pid);
+            int id = it->second;
+            _byPid.erase(it);
+            running--;
+
+            Node& node = _nodes[id];
+            node.finishSeconds = elapsed();
+            node.exitCode = info.exitCode;
+            if (info.exitCode == 0) {
+                node.state = State::Succeeded;
+                for (int next : _dependents[id]) {
+                    if (--waitingFor[next] == 0 && _nodes[next].state == State::Pending) {
+                        ready.push_back(next);
+                    }
+                }
+            } else {
+                node.state = State::Failed;
+                ok = false;
+                cancelDependents(id);
+            }
+        }
+
+        _makespan = elapsed();
+        return ok;
+    }
+
+    const Node& node(int id) const {
+        return _nodes[id];
+    }
+
+    size_t size() const {
+        return _nodes.size();
+    }
+
+    double makespanSeconds() const {
+        return _makespan;
+    }
+
+    // критический путь последнего run(): от задачи, закончившей позже всех,
+    // назад через зависимость, которая освободилась последней. Порядок - от корня
+    std::vector<int> criticalPath() const {
+        std::vector<int> path;
+        int current = -1;
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            if (!ran(_nodes[i])) {
+                continue;
+            }
+            if (current < 0 || _nodes[i].finishSeconds > _nodes[current].finishSeconds) {
+                current = static_cast<int>(i);
+            }
+        }
+
+        while (current >= 0) {
+            path.insert(path.begin(), current);
+            int gate = -1;
+            for (int dep : _nodes[current].deps) {
+                if (ran(_nodes[dep]) && (gate < 0 || _nodes[dep].finishSeconds > _nodes[gate].finishSeconds)) {
+                    gate = dep;
+                }
+            }
+            current = gate;
+        }
+        return path;
+    }
+
+    static const char* stateName(State state) {
+        switch (state) {
+        case State::Pending:   return "pending";
+        case State::Running:   return "running";
+        case State::Succeeded: return "succeeded";
+        case State::Failed:    return "failed";
+        case State::Cancelled: return "cancelled";
+        }
+        return "unknown";
+    }
+
+private:
+    std::vector<Node> _nodes;
+    std::vector<std::vector<int>> _dependents;
+    std::unordered_map<pid_t, int> _byPid;
+    std::chrono::steady_clock::time_point _start;
+    double _makespan = 0;
+
+    double elapsed() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    static bool ran(const Node& node) {
+        return node.state == State::Succeeded || node.state == State::Failed;
+    }
+
+    void cancelDependents(int id) {
+        std::deque<int> queue(_dependents[id].begin(), _dependents[id].end());
+        while (!queue.empty()) {
+            int next = queue.front();
+            queue.pop_front();
+            if (_nodes[next].state != State::Pending) {
+                continue;
+            }
+            _nodes[next].state = State::Cancelled;
+            queue.insert(queue.end(), _dependents[next].begin(), _dependents[next].end());
+        }
+    }
+};
+
+#endif // _WIN32
+
+#endif // JOB_GRAPH_HPP
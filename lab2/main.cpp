@@ -1,6 +1,13 @@
 
 #include "back.hpp"
+#include "job_graph.hpp"
+#include "pipeline.hpp"
+#include "concurrent_launcher.hpp"
+#include "shard_runner.hpp"
+#include <thread>
+#include <atomic>
 #include <iostream>
+#include <fstream>
 #include <chrono>
 
 #ifdef _WIN32
@@ -8,6 +15,10 @@
 #else
 #include <unistd.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <cstring>
+#include <algorithm>
 #endif
 
 
@@ -106,7 +117,24 @@ void testLaunchAndWait() {
     
     std::cout << "\nTesting non-existent program...\n";
     exitCode = BackgroundLauncher::launchAndWait("./nonexistent.sh");
-    std::cout << "Non-existent program result: " << exitCode << " (should be -1)" << std::endl;
+    std::cout << "Non-existent program result: " << exitCode << " (should be -1)"
+              << ", error: " << strerror(BackgroundLauncher::getLastError()) << std::endl;
+
+    std::cout << "\nTesting spawn backends...\n";
+    const BackgroundLauncher::SpawnBackend backends[] = {
+        BackgroundLauncher::SpawnBackend::Fork,
+        BackgroundLauncher::SpawnBackend::VFork,
+        BackgroundLauncher::SpawnBackend::PosixSpawn,
+        BackgroundLauncher::SpawnBackend::Zygote
+    };
+    const char* backendNames[] = {"fork", "vfork", "posix_spawn", "zygote"};
+    for (int i = 0; i < 4; i++) {
+        int ok = BackgroundLauncher::launchAndWait("true", {}, backends[i]);
+        int bad = BackgroundLauncher::launchAndWait("./nonexistent.sh", {}, backends[i]);
+        std::cout << "  " << backendNames[i] << ": true -> " << ok
+                  << ", nonexistent -> " << bad
+                  << " (" << strerror(BackgroundLauncher::getLastError()) << ")" << std::endl;
+    }
 #endif
 }
 
@@ -157,8 +185,495 @@ void testBackgroundLaunch() {
 }
 
 
+#ifndef _WIN32
+void testWaitAny() {
+    std::cout << "\n=== Testing waitAny / poll ===\n";
+
+    BackgroundLauncher::setExitCallback([](const BackgroundLauncher::ExitInfo& info) {
+        std::cout << "  [callback] " << info.program << " (PID " << info.pid
+                  << ") exited with code " << info.exitCode << std::endl;
+    });
+
+    BackgroundLauncher::launch("sleep", {"1"});
+    BackgroundLauncher::launch("sleep", {"0.2"});
+    BackgroundLauncher::launch("false");
+
+    auto early = BackgroundLauncher::poll();
+    std::cout << "poll() right after launch reaped " << early.size() << " processes" << std::endl;
+
+    BackgroundLauncher::ExitInfo info;
+    if (BackgroundLauncher::waitAny(50, info)) {
+        std::cout << "waitAny(50ms) -> " << info.program << std::endl;
+    } else {
+        std::cout << "waitAny(50ms) timed out" << std::endl;
+    }
+    while (BackgroundLauncher::waitAny(-1, info)) {
+        std::cout << "waitAny -> " << info.program << " finished first" << std::endl;
+    }
+
+    BackgroundLauncher::setExitCallback(nullptr);
+}
+
+void testJobQueue() {
+    std::cout << "\n=== Testing job queue ===\n";
+
+    BackgroundLauncher::setMaxConcurrency(2);
+    for (int i = 0; i < 6; i++) {
+        BackgroundLauncher::submit("sleep", {"0.3"}, i == 5 ? 10 : 0);
+    }
+    BackgroundLauncher::submit("./nonexistent.sh");
+
+    std::cout << "Max concurrency: " << BackgroundLauncher::getMaxConcurrency()
+              << ", running: " << BackgroundLauncher::getRunningJobs()
+              << ", queued: " << BackgroundLauncher::getQueueDepth() << std::endl;
+
+    BackgroundLauncher::ExitInfo info;
+    while (BackgroundLauncher::waitAny(-1, info)) {
+        std::cout << "  job #" << info.jobId << " " << info.program;
+        if (info.spawnError != 0) {
+            std::cout << " failed to start: " << strerror(info.spawnError);
+        } else {
+            std::cout << " exit " << info.exitCode
+                      << ", wall " << info.wallSeconds << "s"
+                      << ", cpu " << (info.userSeconds + info.sysSeconds) << "s";
+        }
+        std::cout << " (running: " << BackgroundLauncher::getRunningJobs()
+                  << ", queued: " << BackgroundLauncher::getQueueDepth() << ")" << std::endl;
+    }
+
+    BackgroundLauncher::setMaxConcurrency(0);
+}
+
+void testOutputCapture() {
+    std::cout << "\n=== Testing output capture ===\n";
+
+    size_t lines = 0;
+    BackgroundLauncher::LaunchOptions cbOptions;
+    cbOptions.stdoutMode = BackgroundLauncher::OutputMode::Callback;
+    cbOptions.onOutput = [&lines](pid_t, int, const char* data, size_t size) {
+        lines += std::count(data, data + size, '\n');
+    };
+    BackgroundLauncher::spawn("ls", {"-la", "/"}, cbOptions);
+
+    size_t zygoteBytes = 0;
+    BackgroundLauncher::LaunchOptions zygoteOptions;
+    zygoteOptions.backend = BackgroundLauncher::SpawnBackend::Zygote;
+    zygoteOptions.stdoutMode = BackgroundLauncher::OutputMode::Callback;
+    zygoteOptions.env = {"GREETING=hello from zygote"};
+    zygoteOptions.onOutput = [&zygoteBytes](pid_t, int, const char*, size_t size) {
+        zygoteBytes += size;
+    };
+    BackgroundLauncher::spawn("/bin/sh", {"-c", "echo $GREETING"}, zygoteOptions);
+
+    BackgroundLauncher::LaunchOptions ringOptions;
+    ringOptions.stdoutMode = BackgroundLauncher::OutputMode::RingBuffer;
+    ringOptions.ringCapacity = 16;
+    pid_t seqPid = BackgroundLauncher::spawn("seq", {"1", "100000"}, ringOptions);
+
+    int fileFd = open("capture_test.txt", O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    BackgroundLauncher::LaunchOptions spliceOptions;
+    spliceOptions.stdoutMode = BackgroundLauncher::OutputMode::Splice;
+    spliceOptions.stdoutTarget = fileFd;
+    BackgroundLauncher::spawn("seq", {"1", "100000"}, spliceOptions);
+
+    BackgroundLauncher::waitForAll();
+    close(fileFd);
+
+    struct stat st;
+    stat("capture_test.txt", &st);
+    std::cout << "ls via callback: " << lines << " lines" << std::endl;
+    std::cout << "zygote child with custom env: " << zygoteBytes << " bytes" << std::endl;
+    size_t dropped = BackgroundLauncher::droppedOutput(seqPid, 1);
+    std::string tail = BackgroundLauncher::takeOutput(seqPid, 1);
+    std::replace(tail.begin(), tail.end(), '\n', ' ');
+    std::cout << "seq tail via ring buffer: '" << tail << "' (" << dropped << " bytes dropped)" << std::endl;
+    std::cout << "seq via splice: " << st.st_size << " bytes in capture_test.txt" << std::endl;
+    unlink("capture_test.txt");
+}
+
+void testUsageAccounting() {
+    std::cout << "\n=== Testing resource accounting ===\n";
+
+    BackgroundLauncher::clearUsageRecords();
+    BackgroundLauncher::setUsageSink("usage_test.csv");
+
+    BackgroundLauncher::launchAndWait("sh", {"-c", "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done"});
+    BackgroundLauncher::launch("sleep", {"0.2"});
+    BackgroundLauncher::launch("sh", {"-c", "ls -R /usr/include > /dev/null"});
+    BackgroundLauncher::waitForAll();
+
+    for (const auto& rec : BackgroundLauncher::getUsageRecords()) {
+        std::cout << "  " << rec.program << ": wall " << rec.wallSeconds << "s"
+                  << ", user " << rec.userSeconds << "s, sys " << rec.sysSeconds << "s"
+                  << ", max RSS " << (rec.maxRssKb > 0 ? std::to_string(rec.maxRssKb) + " KB" : std::string("n/a"))
+                  << ", ctx " << rec.voluntarySwitches << "/" << rec.involuntarySwitches << std::endl;
+    }
+
+    BackgroundLauncher::setUsageSink("");
+    std::ifstream csv("usage_test.csv");
+    std::string line;
+    size_t csvLines = 0;
+    while (std::getline(csv, line)) {
+        csvLines++;
+    }
+    std::cout << "usage_test.csv: " << csvLines << " lines (header + records)" << std::endl;
+    unlink("usage_test.csv");
+}
+
+void testJobGraph() {
+    std::cout << "\n=== Testing job graph ===\n";
+
+    JobGraph graph;
+    int fetch = graph.add("fetch", "sleep", {"0.2"});
+    int configure = graph.add("configure", "sleep", {"0.1"});
+    int build = graph.add("build", "sleep", {"0.3"}, {fetch, configure});
+    int lint = graph.add("lint", "false", {}, {fetch});
+    graph.add("report", "true", {}, {lint});
+    graph.add("package", "sleep", {"0.1"}, {build});
+
+    bool ok = graph.run(4);
+    std::cout << "Graph " << (ok ? "succeeded" : "had failures")
+              << ", makespan " << graph.makespanSeconds() << "s" << std::endl;
+    for (size_t i = 0; i < graph.size(); i++) {
+        const JobGraph::Node& node = graph.node(static_cast<int>(i));
+        std::cout << "  " << node.name << ": " << JobGraph::stateName(node.state);
+        if (node.state == JobGraph::State::Succeeded || node.state == JobGraph::State::Failed) {
+            std::cout << " [" << node.startSeconds << "s .. " << node.finishSeconds << "s]";
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << "Critical path:";
+    for (int id : graph.criticalPath()) {
+        std::cout << " " << graph.node(id).name;
+    }
+    std::cout << std::endl;
+}
+
+void testDeadlines() {
+    std::cout << "\n=== Testing deadlines ===\n";
+
+    BackgroundLauncher::LaunchOptions options;
+    options.timeoutMs = 200;
+    options.graceMs = 300;
+    bool timedOut = false;
+    auto t0 = std::chrono::steady_clock::now();
+    int exitCode = BackgroundLauncher::launchAndWait("sleep", {"5"}, options, &timedOut);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "sleep 5 with 200ms deadline: exit " << exitCode
+              << ", timed out: " << (timedOut ? "yes" : "no") << ", took " << ms << "ms" << std::endl;
+
+    t0 = std::chrono::steady_clock::now();
+    exitCode = BackgroundLauncher::launchAndWait("sh", {"-c", "trap '' TERM; exec sleep 5"}, options, &timedOut);
+    ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "SIGTERM-immune sleep: exit " << exitCode
+              << ", timed out: " << (timedOut ? "yes" : "no") << ", took " << ms << "ms (SIGKILL after grace)" << std::endl;
+
+    BackgroundLauncher::launch("sleep", {"0.1"});
+    BackgroundLauncher::launch("sleep", {"3"});
+    std::vector<BackgroundLauncher::ExitInfo> results;
+    BackgroundLauncher::waitForAll(300, 100, &results);
+    std::cout << "Batch with 300ms deadline:" << std::endl;
+    for (const auto& info : results) {
+        std::cout << "  " << info.program << " (PID " << info.pid << "): "
+                  << (info.timedOut ? "timed out" : "finished")
+                  << " after " << info.wallSeconds << "s" << std::endl;
+    }
+}
+
+void testPlacement() {
+    std::cout << "\n=== Testing CPU placement ===\n";
+
+    // ребенок сам смотрит, куда его посадили: affinity, nice (поле 19) и политика (поле 41)
+    const std::string probe = "grep Cpus_allowed_list /proc/$$/status | cut -f2; "
+                              "cut -d' ' -f19,41 /proc/$$/stat";
+
+    BackgroundLauncher::LaunchOptions options;
+    options.stdoutMode = BackgroundLauncher::OutputMode::RingBuffer;
+    options.placement = BackgroundLauncher::Placement::RoundRobinCpu;
+    options.niceValue = 10;
+    options.schedPolicy = SCHED_BATCH;
+
+    std::vector<pid_t> pids;
+    for (int i = 0; i < 3; i++) {
+        pid_t pid = BackgroundLauncher::spawn("sh", {"-c", probe}, options);
+        if (pid > 0) {
+            pids.push_back(pid);
+        } else {
+            std::cout << "Placement launch failed: " << strerror(BackgroundLauncher::getLastError()) << std::endl;
+        }
+    }
+    BackgroundLauncher::waitForAll();
+    for (pid_t pid : pids) {
+        std::string out = BackgroundLauncher::takeOutput(pid, 1);
+        std::replace(out.begin(), out.end(), '\n', ' ');
+        std::cout << "PID " << pid << " cpus / nice policy: " << out << std::endl;
+    }
+
+    options.placement = BackgroundLauncher::Placement::None;
+    options.cpus = {CPU_SETSIZE};
+    pid_t bad = BackgroundLauncher::spawn("true", {}, options);
+    std::cout << "Out-of-range CPU rejected: " << (bad < 0 ? "yes" : "no") << std::endl;
+}
+
+void testPipeline() {
+    std::cout << "\n=== Testing pipelines ===\n";
+
+    BackgroundLauncher::LaunchOptions ringOptions;
+    ringOptions.stdoutMode = BackgroundLauncher::OutputMode::RingBuffer;
+
+    Pipeline grep;
+    grep.add("seq", {"1", "100000"}, true)
+        .add("grep", {"7"})
+        .add("wc", {"-l"}, false, ringOptions);
+    bool ok = grep.run();
+    std::string count = BackgroundLauncher::takeOutput(grep.stage(2).pid, 1);
+    count.erase(std::remove(count.begin(), count.end(), '\n'), count.end());
+    std::cout << "seq | grep 7 | wc -l: " << count << " (ok: " << (ok ? "yes" : "no")
+              << ", " << grep.meteredBytes(0) << " bytes metered after seq)" << std::endl;
+
+    // медленный потребитель: реле упирается в полный пайп и ждет EPOLLOUT
+    Pipeline slow;
+    slow.add("head", {"-c", "4000000", "/dev/zero"}, true)
+        .add("sh", {"-c", "sleep 0.2; wc -c"}, false, ringOptions);
+    slow.run();
+    count = BackgroundLauncher::takeOutput(slow.stage(1).pid, 1);
+    count.erase(std::remove(count.begin(), count.end(), '\n'), count.end());
+    std::cout << "head -c 4000000 | slow wc -c: " << count << " bytes, metered "
+              << slow.meteredBytes(0) << std::endl;
+
+    Pipeline failing;
+    failing.add("sh", {"-c", "echo partial; exit 3"})
+           .add("cat", {}, false, ringOptions);
+    ok = failing.run();
+    BackgroundLauncher::discardOutput(failing.stage(1).pid);
+    std::cout << "sh (exit 3) | cat: ok " << (ok ? "yes" : "no") << ", pipefail exit " << failing.exitCode() << std::endl;
+
+    Pipeline broken;
+    broken.add("true").add("/nonexistent/stage").add("cat");
+    ok = broken.run();
+    std::cout << "Pipeline with a missing program: ok " << (ok ? "yes" : "no") << std::endl;
+    for (size_t i = 0; i < broken.size(); i++) {
+        const Pipeline::Stage& stage = broken.stage(i);
+        std::cout << "  " << stage.program << ": ";
+        if (stage.spawnError != 0) {
+            std::cout << "not started (" << strerror(stage.spawnError) << ")";
+        } else if (stage.pid < 0) {
+            std::cout << "not started";
+        } else {
+            std::cout << "exit " << stage.exitCode;
+        }
+        std::cout << std::endl;
+    }
+}
+
+void testConcurrentLauncher() {
+    std::cout << "\n=== Testing concurrent launcher ===\n";
+
+    ConcurrentLauncher launcher;
+    std::atomic<size_t> launched(0);
+    std::atomic<size_t> reaped(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.push_back(std::thread([&]() {
+            for (int i = 0; i < 10; i++) {
+                if (launcher.launch("true") > 0) {
+                    launched++;
+                }
+            }
+            ConcurrentLauncher::ExitInfo info;
+            while (launcher.waitAny(-1, info)) {
+                reaped++;
+            }
+        }));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::cout << "4 threads: launched " << launched.load() << ", reaped " << reaped.load()
+              << ", still running " << launcher.getRunningCount() << std::endl;
+}
+
+// кэш раскладывает файлы по подкаталогам в один уровень: dir/xx/<ключ>
+void removeCacheDir(const std::string& dir) {
+    DIR* top = opendir(dir.c_str());
+    if (top == nullptr) {
+        return;
+    }
+    while (dirent* sub = readdir(top)) {
+        if (strcmp(sub->d_name, ".") == 0 || strcmp(sub->d_name, "..") == 0) {
+            continue;
+        }
+        std::string subPath = dir + "/" + sub->d_name;
+        if (DIR* inner = opendir(subPath.c_str())) {
+            while (dirent* file = readdir(inner)) {
+                if (strcmp(file->d_name, ".") != 0 && strcmp(file->d_name, "..") != 0) {
+                    unlink((subPath + "/" + file->d_name).c_str());
+                }
+            }
+            closedir(inner);
+            rmdir(subPath.c_str());
+        } else {
+            unlink(subPath.c_str());
+        }
+    }
+    closedir(top);
+    rmdir(dir.c_str());
+}
+
+void testResultCache() {
+    std::cout << "\n=== Testing result cache ===\n";
+
+    std::string dir = "/tmp/lab2_cache_" + std::to_string(getpid());
+    BackgroundLauncher::setResultCache(dir, 1024 * 1024);
+    {
+        std::ofstream input("cache_input.txt");
+        input << "one\ntwo\nthree\n";
+    }
+
+    // "дорогая" детерминированная команда: результат зависит только от входного файла
+    BackgroundLauncher::LaunchOptions options;
+    options.cacheResult = true;
+    options.cacheInputs = {"cache_input.txt"};
+    options.cacheEnv = {"LC_ALL"};
+    const std::vector<std::string> args = {"-c", "sleep 0.3; wc -l < cache_input.txt"};
+
+    for (int run = 0; run < 3; run++) {
+        if (run == 2) {
+            std::ofstream input("cache_input.txt", std::ios::app);
+            input << "four\n";
+        }
+        BackgroundLauncher::CommandResult result;
+        auto t0 = std::chrono::steady_clock::now();
+        int exitCode = BackgroundLauncher::launchAndWait("sh", args, options, result);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+        result.out.erase(std::remove(result.out.begin(), result.out.end(), '\n'), result.out.end());
+        std::cout << "Run " << run + 1 << ": exit " << exitCode << ", lines " << result.out
+                  << (result.fromCache ? " (cache hit, " : " (executed, ") << ms << "ms)" << std::endl;
+    }
+
+    // без кэша путей "sh" - голое имя: ключ все равно строится по файлу, найденному в PATH
+    BackgroundLauncher::setPathCache(false);
+    {
+        BackgroundLauncher::CommandResult result;
+        BackgroundLauncher::launchAndWait("sh", args, options, result);
+        std::cout << "Path cache off: " << (result.fromCache ? "cache hit" : "executed")
+                  << " (should be cache hit)" << std::endl;
+    }
+    BackgroundLauncher::setPathCache(true);
+
+    // stdin в ключ не попадает: из пайпа не кэшируем, из файла - только если он в cacheInputs
+    BackgroundLauncher::LaunchOptions stdinOptions = options;
+    const std::vector<std::string> wcArgs = {"-l"};
+    for (int run = 0; run < 2; run++) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            break;
+        }
+        ssize_t unused = write(fds[1], "a\nb\n", 4);
+        (void)unused;
+        close(fds[1]);
+        stdinOptions.stdinFd = fds[0];
+        BackgroundLauncher::CommandResult result;
+        BackgroundLauncher::launchAndWait("wc", wcArgs, stdinOptions, result);
+        close(fds[0]);
+        if (run == 1) {
+            std::cout << "stdin from a pipe: " << (result.fromCache ? "cache hit" : "executed")
+                      << " (should be executed)" << std::endl;
+        }
+    }
+    for (int run = 0; run < 2; run++) {
+        int fd = open("cache_input.txt", O_RDONLY | O_CLOEXEC);
+        stdinOptions.stdinFd = fd;
+        BackgroundLauncher::CommandResult result;
+        BackgroundLauncher::launchAndWait("wc", wcArgs, stdinOptions, result);
+        close(fd);
+        if (run == 1) {
+            std::cout << "stdin from a listed input: " << (result.fromCache ? "cache hit" : "executed")
+                      << " (should be cache hit)" << std::endl;
+        }
+    }
+
+    BackgroundLauncher::CacheStats stats = BackgroundLauncher::getCacheStats();
+    std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.stores << " stores, " << stats.bytes << " bytes on disk" << std::endl;
+
+    BackgroundLauncher::setResultCache("");
+    unlink("cache_input.txt");
+    removeCacheDir(dir);
+}
+
+void testPathCache() {
+    std::cout << "\n=== Testing path cache ===\n";
+
+    BackgroundLauncher::PathCacheStats before = BackgroundLauncher::getPathCacheStats();
+    for (int i = 0; i < 3; i++) {
+        BackgroundLauncher::launchAndWait("true");
+    }
+
+    // новый файл в каталоге из PATH - inotify сбрасывает кэш
+    std::string dir = "/tmp/lab2_path_" + std::to_string(getpid());
+    mkdir(dir.c_str(), 0755);
+    std::string savedPath = getenv("PATH") != nullptr ? getenv("PATH") : "";
+    setenv("PATH", (dir + ":" + savedPath).c_str(), 1);
+    BackgroundLauncher::launchAndWait("true");
+    std::string shadow = dir + "/true";
+    {
+        std::ofstream script(shadow.c_str());
+        script << "#!/bin/sh\nexit 7\n";
+    }
+    chmod(shadow.c_str(), 0755);
+    int exitCode = BackgroundLauncher::launchAndWait("true");
+    std::cout << "'true' shadowed by a new script earlier in PATH: exit " << exitCode << " (should be 7)" << std::endl;
+
+    setenv("PATH", savedPath.c_str(), 1);
+    exitCode = BackgroundLauncher::launchAndWait("true");
+    std::cout << "PATH restored: exit " << exitCode << " (should be 0)" << std::endl;
+    unlink(shadow.c_str());
+    rmdir(dir.c_str());
+
+    BackgroundLauncher::PathCacheStats after = BackgroundLauncher::getPathCacheStats();
+    std::cout << "Path cache: " << after.hits - before.hits << " hits, " << after.misses - before.misses
+              << " misses, " << after.invalidations - before.invalidations << " invalidations" << std::endl;
+}
+
+void testShardRunner() {
+    std::cout << "\n=== Testing shard runner ===\n";
+
+    system("seq 1 300000 > shard_input.txt");
+
+    // map: сколько строк с семеркой в своем диапазоне; reduce: сумма
+    ShardRunner runner("shard_input.txt",
+                       "sh", {"-c", "head -c \"$SHARD_LENGTH\" | grep -c 7"},
+                       "awk", {"{ s += $1 } END { print s }"});
+    runner.setShardCount(4);
+    int resultFd = open("shard_result.txt", O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    bool ok = runner.run(resultFd);
+    close(resultFd);
+
+    std::ifstream result("shard_result.txt");
+    std::string total;
+    std::getline(result, total);
+    std::cout << "Sharded grep -c 7 over seq 1 300000: " << total << " (ok: " << (ok ? "yes" : "no") << ")" << std::endl;
+    for (size_t i = 0; i < runner.size(); i++) {
+        const ShardRunner::Shard& shard = runner.shard(i);
+        std::cout << "  shard " << i << ": bytes " << shard.begin << ".." << shard.end
+                  << ", exit " << shard.exitCode << ", " << shard.outputBytes << " bytes to merge" << std::endl;
+    }
+
+    std::cout << "Single grep for comparison: " << std::flush;
+    BackgroundLauncher::launchAndWait("sh", {"-c", "grep -c 7 shard_input.txt"});
+    unlink("shard_input.txt");
+    unlink("shard_result.txt");
+}
+#endif
 
 int main() {
+#ifndef _WIN32
+    // пока процесс маленький - дальше зигота форкается вместо нас
+    BackgroundLauncher::startZygote();
+#endif
+
     std::cout << "=== Cross-Platform Background Launcher Test ===\n";
     
 #ifdef _WIN32
@@ -171,6 +686,20 @@ int main() {
     
     testLaunchAndWait();
     testBackgroundLaunch();
+#ifndef _WIN32
+    testWaitAny();
+    testJobQueue();
+    testOutputCapture();
+    testUsageAccounting();
+    testJobGraph();
+    testDeadlines();
+    testPlacement();
+    testPipeline();
+    testConcurrentLauncher();
+    testResultCache();
+    testPathCache();
+    testShardRunner();
+#endif
     
     std::cout << "\n=== Final check ===\n";
     std::cout << "Processes still running: " << BackgroundLauncher::getRunningCount() << std::endl;
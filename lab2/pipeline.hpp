@@ -0,0 +1,206 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "back.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#ifndef _WIN32
+
+// Конвейер producer | filter | consumer без sh -c: stdout каждой стадии пайпом идет
+// в stdin следующей. Стадия с meter гонит вывод через родителя (splice пайп -> пайп,
+// в user space ничего не копируется) и считает байты. Ждется целиком через wait()
+class Pipeline {
+public:
+    struct Stage {
+        std::string program;
+        std::vector<std::string> args;
+        BackgroundLauncher::LaunchOptions options;
+        bool metered;
+
+        pid_t pid;       // -1, если не запустилась
+        int exitCode;    // -1 - убита сигналом или не запускалась
+        int termSignal;
+        int spawnError;  // errno неудачного запуска
+    };
+
+    // добавить стадию в конец. meter - гнать ее stdout к следующей через родителя со счетчиком
+    Pipeline& add(const std::string& program, const std::vector<std::string>& args = {},
+                  bool meter = false,
+                  const BackgroundLauncher::LaunchOptions& options = BackgroundLauncher::LaunchOptions()) {
+        Stage stage;
+        stage.program = program;
+        stage.args = args;
+        stage.options = options;
+        stage.metered = meter;
+        stage.pid = -1;
+        stage.exitCode = -1;
+        stage.termSignal = 0;
+        stage.spawnError = 0;
+        _stages.push_back(stage);
+        return *this;
+    }
+
+    // запустить все стадии. stdinFd - stdin первой, stdoutFd - stdout последней (-1 - как у нас).
+    // false, если какая-то не запустилась; уже запущенные получат EOF/SIGPIPE, wait() их пожмет
+    bool start(int stdinFd = -1, int stdoutFd = -1) {
+        _byPid.clear();
+        _meters.assign(_stages.size(), std::shared_ptr<Meter>());
+        bool ok = !_stages.empty();
+        int input = stdinFd;
+
+        for (size_t i = 0; i < _stages.size() && ok; i++) {
+            Stage& stage = _stages[i];
+            stage.pid = -1;
+            stage.exitCode = -1;
+            stage.termSignal = 0;
+            stage.spawnError = 0;
+
+            BackgroundLauncher::LaunchOptions options = stage.options;
+            options.stdinFd = input;
+            int nextInput = -1;
+            int ourEnd = -1; // конец пайпа, который мы держим только до запуска стадии
+
+            if (i + 1 == _stages.size()) {
+                options.stdoutFd = stdoutFd;
+            } else {
+                int fds[2];
+                if (pipe2(fds, O_CLOEXEC) < 0) {
+                    stage.spawnError = errno;
+                    ok = false;
+                    break;
+                }
+                nextInput = fds[0];
+                if (stage.metered) {
+                    // наш конец реле неблокирующий: переполнение - повод ждать EPOLLOUT, а не висеть
+                    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+                    std::shared_ptr<Meter> meter(new Meter());
+                    meter->fd = fds[1];
+                    meter->bytes = 0;
+                    _meters[i] = meter;
+                    options.stdoutMode = BackgroundLauncher::OutputMode::Splice;
+                    options.stdoutTarget = fds[1];
+                    options.onOutput = [meter](pid_t, int stream, const char*, size_t size) {
+                        if (stream != 1) {
+                            return;
+                        }
+                        if (size > 0) {
+                            meter->bytes += size;
+                        } else if (meter->fd >= 0) {
+                            close(meter->fd); // следующая стадия увидит EOF
+                            meter->fd = -1;
+                        }
+                    };
+                } else {
+                    options.stdoutMode = BackgroundLauncher::OutputMode::Inherit;
+                    options.stdoutFd = fds[1];
+                    ourEnd = fds[1];
+                }
+            }
+
+            stage.pid = BackgroundLauncher::spawn(stage.program, stage.args, options);
+            if (stage.pid < 0) {
+                stage.spawnError = BackgroundLauncher::getLastError();
+                ok = false;
+                if (_meters[i] && _meters[i]->fd >= 0) {
+                    close(_meters[i]->fd);
+                    _meters[i]->fd = -1;
+                }
+                if (nextInput >= 0) {
+                    close(nextInput);
+                    nextInput = -1;
+                }
+            } else {
+                _byPid[stage.pid] = i;
+            }
+
+            if (ourEnd >= 0) {
+                close(ourEnd);
+            }
+            if (input >= 0 && input != stdinFd) {
+                close(input);
+            }
+            input = nextInput;
+        }
+
+        if (input >= 0 && input != stdinFd) {
+            close(input);
+        }
+        return ok;
+    }
+
+    // дождаться всех стадий. true, если все вышли с 0 (как set -o pipefail)
+    bool wait() {
+        while (!_byPid.empty()) {
+            BackgroundLauncher::ExitInfo info;
+            bool got = BackgroundLauncher::waitAny(-1, info, [this](const BackgroundLauncher::ExitInfo& e) {
+                return _byPid.find(e.pid) != _byPid.end();
+            });
+            if (!got) {
+                break;
+            }
+            auto it = _byPid.find(info.pid);
+            Stage& stage = _stages[it->second];
+            stage.exitCode = info.exitCode;
+            stage.termSignal = info.termSignal;
+            _byPid.erase(it);
+        }
+        return succeeded();
+    }
+
+    bool run(int stdinFd = -1, int stdoutFd = -1) {
+        bool started = start(stdinFd, stdoutFd);
+        return wait() && started;
+    }
+
+    bool succeeded() const {
+        for (const auto& stage : _stages) {
+            if (stage.pid < 0 || stage.exitCode != 0) {
+                return false;
+            }
+        }
+        return !_stages.empty();
+    }
+
+    // код выхода конвейера как в shell с pipefail: последний ненулевой, иначе 0
+    int exitCode() const {
+        int code = 0;
+        for (const auto& stage : _stages) {
+            if (stage.exitCode != 0) {
+                code = stage.exitCode;
+            }
+        }
+        return code;
+    }
+
+    const Stage& stage(size_t i) const {
+        return _stages[i];
+    }
+
+    size_t size() const {
+        return _stages.size();
+    }
+
+    // сколько байт прошло через реле после стадии i (0, если она без meter)
+    size_t meteredBytes(size_t i) const {
+        return (i < _meters.size() && _meters[i]) ? _meters[i]->bytes : 0;
+    }
+
+private:
+    // живет и в колбэке лаунчера, поэтому shared_ptr: колбэк может пережить конвейер
+    struct Meter {
+        int fd;
+        size_t bytes;
+    };
+
+    std::vector<Stage> _stages;
+    std::vector<std::shared_ptr<Meter>> _meters;
+    std::unordered_map<pid_t, size_t> _byPid;
+};
+
+#endif // _WIN32
+
+#endif // PIPELINE_HPP
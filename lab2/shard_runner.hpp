@@ -0,0 +1,321 @@
+#ifndef SHARD_RUNNER_HPP
+#define SHARD_RUNNER_HPP
+
+#include "back.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <unordered_map>
+
+#ifndef _WIN32
+
+// map/reduce на процессах: входной файл режется по границам записей на диапазоны байт,
+// на каждый диапазон - свой worker (не больше maxConcurrency одновременно), вывод каждого
+// worker, как только тот закончил, целиком уходит в stdin единственного merge.
+//
+// Worker сам ничего не копирует: его stdin - входной файл, уже спозиционированный на начало
+// диапазона, а границы приходят в окружении (SHARD_INPUT, SHARD_BEGIN, SHARD_END,
+// SHARD_LENGTH, SHARD_INDEX, SHARD_COUNT) и подстановками {input} {begin} {end} {length} {index}
+// в аргументах. Например: sh -c 'head -c "$SHARD_LENGTH" | grep -c foo'.
+// Вывод worker копится во временном файле и переливается в merge через splice
+class ShardRunner {
+public:
+    struct Shard {
+        off_t begin;
+        off_t end;
+        pid_t pid;
+        int exitCode;   // -1 - убит сигналом или не запустился
+        int spawnError;
+        size_t outputBytes;
+        double seconds;
+    };
+
+    ShardRunner(const std::string& input,
+                const std::string& worker, const std::vector<std::string>& workerArgs,
+                const std::string& merge, const std::vector<std::string>& mergeArgs = {})
+        : _input(input), _worker(worker), _workerArgs(workerArgs), _merge(merge), _mergeArgs(mergeArgs),
+          _shardCount(0), _delimiter('\n'), _mergePid(-1), _mergeExitCode(-1) {}
+
+    // сколько диапазонов, 0 - по числу ядер
+    void setShardCount(size_t count) {
+        _shardCount = count;
+    }
+
+    // разделитель записей, по умолчанию '\n'
+    void setDelimiter(char delimiter) {
+        _delimiter = delimiter;
+    }
+
+    // запустить и дождаться всего. mergeStdoutFd - куда писать итог (-1 - наш stdout).
+    // Это не должен быть пайп, который читаем мы сами: пока merge не съест вход, мы его не читаем.
+    // true, если все worker и merge вышли с 0
+    bool run(int mergeStdoutFd = -1, size_t maxConcurrency = 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (maxConcurrency == 0) {
+            maxConcurrency = cores > 0 ? static_cast<size_t>(cores) : 1;
+        }
+        _shards.clear();
+        _mergePid = -1;
+        _mergeExitCode = -1;
+
+        if (!split(_shardCount > 0 ? _shardCount : maxConcurrency)) {
+            return false;
+        }
+
+        int mergeIn[2];
+        if (pipe2(mergeIn, O_CLOEXEC) < 0) {
+            return false;
+        }
+        BackgroundLauncher::LaunchOptions mergeOptions;
+        mergeOptions.stdinFd = mergeIn[0];
+        mergeOptions.stdoutFd = mergeStdoutFd;
+        _mergePid = BackgroundLauncher::spawn(_merge, _mergeArgs, mergeOptions);
+        close(mergeIn[0]);
+        if (_mergePid < 0) {
+            close(mergeIn[1]);
+            return false;
+        }
+
+        bool ok = true;
+        std::deque<size_t> ready;
+        for (size_t i = 0; i < _shards.size(); i++) {
+            ready.push_back(i);
+        }
+        std::unordered_map<pid_t, size_t> byPid;
+        std::unordered_map<pid_t, int> outputs; // pid -> временный файл с выводом
+
+        while (!ready.empty() || !byPid.empty()) {
+            while (!ready.empty() && byPid.size() < maxConcurrency) {
+                size_t index = ready.front();
+                ready.pop_front();
+                int output = -1;
+                pid_t pid = startWorker(index, output);
+                if (pid < 0) {
+                    ok = false;
+                    continue;
+                }
+                byPid[pid] = index;
+                outputs[pid] = output;
+            }
+            if (byPid.empty()) {
+                continue;
+            }
+
+            BackgroundLauncher::ExitInfo info;
+            bool got = BackgroundLauncher::waitAny(-1, info, [&byPid](const BackgroundLauncher::ExitInfo& e) {
+                return byPid.find(e.pid) != byPid.end();
+            });
+            if (!got) {
+                break;
+            }
+
+            Shard& shard = _shards[byPid[info.pid]];
+            shard.exitCode = info.exitCode;
+            shard.seconds = info.wallSeconds;
+            int output = outputs[info.pid];
+            byPid.erase(info.pid);
+            outputs.erase(info.pid);
+
+            // вывод неудачного worker в merge не пускаем: частичный результат хуже явной ошибки
+            if (info.exitCode == 0) {
+                // merge ушел раньше времени - splice получит EPIPE, SIGPIPE нас не касается.
+                // Блокируем только на перекачку: worker'ы наследуют маску при запуске
+                sigset_t savedMask;
+                bool sigpipePending = BackgroundLauncher::blockSigpipe(savedMask);
+                if (!feed(output, mergeIn[1], shard.outputBytes)) {
+                    ok = false;
+                }
+                BackgroundLauncher::restoreSigpipe(savedMask, sigpipePending);
+            } else {
+                ok = false;
+            }
+            close(output);
+        }
+
+        close(mergeIn[1]); // merge видит EOF
+
+        BackgroundLauncher::ExitInfo info;
+        pid_t mergePid = _mergePid;
+        if (BackgroundLauncher::waitAny(-1, info, [mergePid](const BackgroundLauncher::ExitInfo& e) {
+                return e.pid == mergePid;
+            })) {
+            _mergeExitCode = info.exitCode;
+        }
+        return ok && _mergeExitCode == 0;
+    }
+
+    const Shard& shard(size_t i) const {
+        return _shards[i];
+    }
+
+    size_t size() const {
+        return _shards.size();
+    }
+
+    int mergeExitCode() const {
+        return _mergeExitCode;
+    }
+
+private:
+    std::string _input;
+    std::string _worker;
+    std::vector<std::string> _workerArgs;
+    std::string _merge;
+    std::vector<std::string> _mergeArgs;
+    size_t _shardCount;
+    char _delimiter;
+    std::vector<Shard> _shards;
+    pid_t _mergePid;
+    int _mergeExitCode;
+
+    // граница не раньше offset, сразу после разделителя (или конец файла)
+    off_t nextBoundary(int fd, off_t offset, off_t size) const {
+        if (offset <= 0) {
+            return 0;
+        }
+        char buf[64 * 1024];
+        off_t pos = offset - 1; // разделитель прямо перед offset - граница уже тут
+        while (pos < size) {
+            ssize_t n = pread(fd, buf, sizeof(buf), pos);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            const char* hit = static_cast<const char*>(memchr(buf, _delimiter, static_cast<size_t>(n)));
+            if (hit != nullptr) {
+                return pos + (hit - buf) + 1;
+            }
+            pos += n;
+        }
+        return size;
+    }
+
+    bool split(size_t count) {
+        int fd = open(_input.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+
+        off_t size = st.st_size;
+        off_t begin = 0;
+        for (size_t i = 1; i <= count && begin < size; i++) {
+            off_t end = (i == count) ? size : nextBoundary(fd, size / static_cast<off_t>(count) * static_cast<off_t>(i), size);
+            if (end <= begin) {
+                continue; // запись длиннее доли - соседний диапазон ее уже забрал
+            }
+            Shard shard;
+            shard.begin = begin;
+            shard.end = end;
+            shard.pid = -1;
+            shard.exitCode = -1;
+            shard.spawnError = 0;
+            shard.outputBytes = 0;
+            shard.seconds = 0;
+            _shards.push_back(shard);
+            begin = end;
+        }
+        close(fd);
+        return true;
+    }
+
+    static void replaceAll(std::string& str, const std::string& from, const std::string& to) {
+        for (size_t pos = str.find(from); pos != std::string::npos; pos = str.find(from, pos + to.size())) {
+            str.replace(pos, from.size(), to);
+        }
+    }
+
+    // временный файл под вывод: уже удален, живет, пока открыт
+    static int tempOutput() {
+#ifdef O_TMPFILE
+        int fd = open("/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (fd >= 0) {
+            return fd;
+        }
+#endif
+        char name[] = "/tmp/lab2_shard_XXXXXX";
+        int fd2 = mkostemp(name, O_CLOEXEC);
+        if (fd2 >= 0) {
+            unlink(name);
+        }
+        return fd2;
+    }
+
+    pid_t startWorker(size_t index, int& output) {
+        Shard& shard = _shards[index];
+        const std::string values[5] = {
+            _input, std::to_string(static_cast<long long>(shard.begin)),
+            std::to_string(static_cast<long long>(shard.end)),
+            std::to_string(static_cast<long long>(shard.end - shard.begin)), std::to_string(index)
+        };
+        static const char* const names[5] = {"input", "begin", "end", "length", "index"};
+        static const char* const envNames[5] = {"SHARD_INPUT", "SHARD_BEGIN", "SHARD_END", "SHARD_LENGTH", "SHARD_INDEX"};
+
+        std::vector<std::string> args = _workerArgs;
+        for (auto& arg : args) {
+            for (int i = 0; i < 5; i++) {
+                replaceAll(arg, std::string("{") + names[i] + "}", values[i]);
+            }
+        }
+
+        BackgroundLauncher::LaunchOptions options;
+        for (char** e = environ; *e != nullptr; e++) {
+            options.env.push_back(*e);
+        }
+        for (int i = 0; i < 5; i++) {
+            options.env.push_back(std::string(envNames[i]) + "=" + values[i]);
+        }
+        options.env.push_back("SHARD_COUNT=" + std::to_string(_shards.size()));
+
+        int in = open(_input.c_str(), O_RDONLY | O_CLOEXEC);
+        output = tempOutput();
+        if (in < 0 || output < 0 || lseek(in, shard.begin, SEEK_SET) != shard.begin) {
+            shard.spawnError = errno;
+            if (in >= 0) close(in);
+            if (output >= 0) close(output);
+            return -1;
+        }
+        options.stdinFd = in;
+        options.stdoutFd = output;
+
+        shard.pid = BackgroundLauncher::spawn(_worker, args, options);
+        close(in);
+        if (shard.pid < 0) {
+            shard.spawnError = BackgroundLauncher::getLastError();
+            close(output);
+        }
+        return shard.pid;
+    }
+
+    // весь вывод worker - в stdin merge, мимо user space
+    static bool feed(int output, int mergeIn, size_t& bytes) {
+        struct stat st;
+        if (fstat(output, &st) != 0) {
+            return false;
+        }
+        loff_t offset = 0;
+        while (offset < st.st_size) {
+            ssize_t n = splice(output, &offset, mergeIn, nullptr, static_cast<size_t>(st.st_size - offset), SPLICE_F_MOVE);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            bytes += static_cast<size_t>(n);
+        }
+        return true;
+    }
+};
+
+#endif // _WIN32
+
+#endif // SHARD_RUNNER_HPP
@@ -0,0 +1,913 @@
+// Бенчмарки обмена между процессами через общую память.
+// Каждый случай печатает строку JSON.
+//   ring - очереди из shmring.hpp против очереди под семафором (как SharedMem::Lock):
+//     throughput: producers процессов пишут, consumers читают пачками,
+//                 msgs_per_sec и задержка от записи до чтения (с очередью),
+//                 intact - все сообщения дошли ровно по разу
+//     pingpong:   сообщение туда и обратно по одному, задержка в одну сторону без очереди
+//   seqlock - procs читателей и один писатель над SharedMem в течение --seconds:
+//     чтение под Lock()/Unlock() против Read(); reads_per_sec в сумме по читателям,
+//     torn - прочитанные копии, где поля записаны разными итерациями писателя
+//   lock - procs процессов по --messages/10 раз берут блокировку и увеличивают счетчик:
+//     именованный семафор (как раньше в SharedMem) против SharedMutex в сегменте.
+//     lost - потерянные увеличения (должно быть 0), recovered - следующий Lock()
+//     после смерти владельца под блокировкой вернул управление (семафор ждем 1 с)
+//   atomic - procs процессов по --messages/10 раз увеличивают поле SharedMem:
+//     под Lock()/Unlock(), FetchAdd() и Update() (цикл CAS); incs_per_sec и lost
+//   striped - procs процессов по --messages/10 раз увеличивают счетчик: один общий,
+//     у каждого процесса свой, но соседние в одной строке кэша (packed),
+//     и StripedCounter из shmcounter.hpp (по строке на ядро); incs_per_sec и lost по сумме
+//   notify - два процесса по очереди меняют поле и ждут ответа (--messages/5000 раз):
+//     опрос со сном 1 мс (как потоки приложения раньше) против WaitChange();
+//     задержка в одну сторону от изменения до того, как другой процесс его увидел
+//   mapping - процесс подключается к готовому сегменту в 64 МБ с разными SharedMemOptions:
+//     open_ms - конструктор SharedMem, first_pass_ms/second_pass_ms - чтение всего сегмента
+//     в первый и во второй раз; applied - какие опции получилось применить
+//   hash - ShmHashTable из shmhash.hpp на 16384 ячейки с 12000 ключами, procs процессов
+//     по --messages операций со случайными ключами: только Find() и 90% Find() + 10% Update(+1);
+//     ops_per_sec в сумме, missed - ненайденные ключи, lost - потерянные увеличения,
+//     статистика пробирования
+//
+// ./LAB3_BENCH [--cases ring,seqlock,lock,atomic,striped,notify,mapping,hash] [--messages N] [--procs 1,2,4] [--seconds 0.5]
+#include "shmem.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#if defined(_WIN32)
+int main() {
+    std::cerr << "Benchmark is available on UNIX only" << std::endl;
+    return 1;
+}
+#else
+#include "shmring.hpp"
+#include "shmcounter.hpp"
+#include "shmhash.hpp"
+
+#include <unistd.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/wait.h>
+
+static long long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> result;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+static void printStats(std::ostream& out, const char* name, const std::vector<double>& us) {
+    out << ",\"" << name << "_p50_us\":" << percentile(us, 0.50)
+        << ",\"" << name << "_p90_us\":" << percentile(us, 0.90)
+        << ",\"" << name << "_p99_us\":" << percentile(us, 0.99)
+        << ",\"" << name << "_max_us\":" << percentile(us, 1.0);
+}
+
+// ожидание без системного вызова, пока есть шанс, что другая сторона на соседнем ядре
+static void backoff(unsigned& spins) {
+    if (++spins > 64) {
+        sched_yield();
+    }
+}
+
+// запустить count процессов, каждому - свой номер
+template <class Fn> static std::vector<pid_t> forkWorkers(size_t count, Fn fn) {
+    std::vector<pid_t> pids;
+    for (size_t i = 0; i < count; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            fn(i);
+            _exit(0);
+        }
+        if (pid > 0) {
+            pids.push_back(pid);
+        }
+    }
+    return pids;
+}
+
+static void waitWorkers(const std::vector<pid_t>& pids) {
+    for (pid_t pid : pids) {
+        int status;
+        waitpid(pid, &status, 0);
+    }
+}
+
+// ---------------- ring ----------------
+
+struct Message {
+    uint64_t seq;
+    long long sentNs;
+};
+
+enum { RingSize = 4096, MaxSamples = 1 << 16, SampleEvery = 16 };
+
+// Одинаковый интерфейс для очередей: пачкой без ожидания и по одному с ожиданием
+template <class Ring> struct SpinQueue {
+    Ring ring;
+    size_t PushBatch(const Message* items, size_t count) { return ring.PushBatch(items, count); }
+    size_t PopBatch(Message* items, size_t count) { return ring.PopBatch(items, count); }
+    void Push(const Message& item) {
+        unsigned spins = 0;
+        while (!ring.TryPush(item)) {
+            backoff(spins);
+        }
+    }
+    void Pop(Message& item) {
+        unsigned spins = 0;
+        while (!ring.TryPop(item)) {
+            backoff(spins);
+        }
+    }
+};
+
+template <class Ring> struct FutexQueue {
+    Ring ring;
+    size_t PushBatch(const Message* items, size_t count) { return ring.PushBatch(items, count); }
+    size_t PopBatch(Message* items, size_t count) { return ring.PopBatch(items, count); }
+    void Push(const Message& item) { ring.Push(item); }
+    void Pop(Message& item) { ring.Pop(item); }
+};
+
+// Так обмениваются через SharedMem сейчас: любое действие - под семафором
+static sem_t* g_queue_sem = nullptr;
+
+struct SemQueue {
+    uint64_t head;
+    uint64_t tail;
+    Message slots[RingSize];
+
+    SemQueue() : head(0), tail(0) {}
+    size_t PushBatch(const Message* items, size_t count) {
+        sem_wait(g_queue_sem);
+        size_t n = std::min<size_t>(count, RingSize - (tail - head));
+        for (size_t i = 0; i < n; i++) {
+            slots[(tail + i) % RingSize] = items[i];
+        }
+        tail += n;
+        sem_post(g_queue_sem);
+        return n;
+    }
+    size_t PopBatch(Message* items, size_t count) {
+        sem_wait(g_queue_sem);
+        size_t n = std::min<size_t>(count, tail - head);
+        for (size_t i = 0; i < n; i++) {
+            items[i] = slots[(head + i) % RingSize];
+        }
+        head += n;
+        sem_post(g_queue_sem);
+        return n;
+    }
+    void Push(const Message& item) {
+        unsigned spins = 0;
+        while (PushBatch(&item, 1) == 0) {
+            backoff(spins);
+        }
+    }
+    void Pop(Message& item) {
+        unsigned spins = 0;
+        while (PopBatch(&item, 1) == 0) {
+            backoff(spins);
+        }
+    }
+};
+
+template <class Queue> struct RingSegment {
+    Queue forward;
+    Queue backward;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> go;
+    std::atomic<uint64_t> consumed;
+    std::atomic<uint64_t> seqSum;   // сумма номеров прочитанного: потери и дубли ее меняют
+    std::atomic<uint32_t> samples;
+    float latencyUs[MaxSamples];
+};
+
+template <class Queue> static void runRingCase(const char* name, size_t producers, size_t consumers,
+                                               size_t messages, size_t batch) {
+    cplib::SharedMem<RingSegment<Queue>> shm("lab3_bench_ring");
+    RingSegment<Queue>* seg = shm.Data();
+    if (seg == nullptr) {
+        std::cerr << "Cannot create shared memory for " << name << std::endl;
+        return;
+    }
+    uint32_t workers = static_cast<uint32_t>(producers + consumers);
+
+    // throughput: все стартуют одновременно по флагу go
+    std::vector<pid_t> pids = forkWorkers(consumers, [&](size_t) {
+        seg->ready.fetch_add(1);
+        while (seg->go.load() == 0) {
+            sched_yield();
+        }
+        std::vector<Message> buf(batch);
+        unsigned spins = 0;
+        while (seg->consumed.load(std::memory_order_relaxed) < messages) {
+            size_t n = seg->forward.PopBatch(buf.data(), batch);
+            if (n == 0) {
+                backoff(spins);
+                continue;
+            }
+            spins = 0;
+            long long now = monotonicNs();
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n; i++) {
+                sum += buf[i].seq;
+                if (buf[i].seq % SampleEvery == 0) {
+                    uint32_t slot = seg->samples.fetch_add(1);
+                    if (slot < MaxSamples) {
+                        seg->latencyUs[slot] = static_cast<float>((now - buf[i].sentNs) / 1000.0);
+                    }
+                }
+            }
+            seg->seqSum.fetch_add(sum);
+            seg->consumed.fetch_add(n);
+        }
+    });
+    std::vector<pid_t> producerPids = forkWorkers(producers, [&](size_t index) {
+        seg->ready.fetch_add(1);
+        while (seg->go.load() == 0) {
+            sched_yield();
+        }
+        size_t share = messages / producers + (index < messages % producers ? 1 : 0);
+        std::vector<Message> buf(batch);
+        uint64_t seq = index;
+        size_t sent = 0;
+        unsigned spins = 0;
+        while (sent < share) {
+            size_t want = std::min(batch, share - sent);
+            long long now = monotonicNs();
+            for (size_t i = 0; i < want; i++) {
+                buf[i].seq = seq;
+                buf[i].sentNs = now;
+                seq += producers;
+            }
+            size_t n = seg->forward.PushBatch(buf.data(), want);
+            seq -= (want - n) * producers; // не влезшие пойдут в следующий раз с теми же номерами
+            sent += n;
+            if (n == 0) {
+                backoff(spins);
+            } else {
+                spins = 0;
+            }
+        }
+    });
+    pids.insert(pids.end(), producerPids.begin(), producerPids.end());
+
+    while (seg->ready.load() < workers) {
+        sched_yield();
+    }
+    long long begin = monotonicNs();
+    seg->go.store(1);
+    waitWorkers(pids);
+    double seconds = (monotonicNs() - begin) / 1e9;
+    bool intact = seg->consumed.load() == messages &&
+                  seg->seqSum.load() == static_cast<uint64_t>(messages) * (messages - 1) / 2;
+
+    std::vector<double> queued;
+    uint32_t sampleCount = std::min<uint32_t>(seg->samples.load(), MaxSamples);
+    for (uint32_t i = 0; i < sampleCount; i++) {
+        queued.push_back(seg->latencyUs[i]);
+    }
+
+    // pingpong: по одному сообщению туда и обратно, ждущая сторона пользуется Pop()
+    size_t rounds = std::min<size_t>(messages / 10, 20000);
+    pid_t echo = forkWorkers(1, [&](size_t) {
+        Message msg;
+        for (size_t i = 0; i < rounds; i++) {
+            seg->forward.Pop(msg);
+            seg->backward.Push(msg);
+        }
+    }).front();
+    std::vector<double> oneWay;
+    for (size_t i = 0; i < rounds; i++) {
+        Message msg;
+        msg.seq = i;
+        msg.sentNs = monotonicNs();
+        seg->forward.Push(msg);
+        seg->backward.Pop(msg);
+        oneWay.push_back((monotonicNs() - msg.sentNs) / 2000.0);
+    }
+    waitWorkers(std::vector<pid_t>(1, echo));
+
+    std::ostringstream line;
+    line << "{\"case\":\"ring\",\"queue\":\"" << name << "\""
+         << ",\"producers\":" << producers
+         << ",\"consumers\":" << consumers
+         << ",\"batch\":" << batch
+         << ",\"messages\":" << messages
+         << ",\"intact\":" << (intact ? "true" : "false")
+         << ",\"msgs_per_sec\":" << (seconds > 0 ? messages / seconds : 0);
+    printStats(line, "queued", queued);
+    line << ",\"pingpong_rounds\":" << rounds;
+    printStats(line, "oneway", oneWay);
+    line << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runRing(size_t messages, const std::vector<size_t>& procs) {
+    g_queue_sem = sem_open("/lab3_bench_queue_sem", O_CREAT, 0600, 1);
+    if (g_queue_sem == SEM_FAILED) {
+        std::cerr << "Cannot create semaphore" << std::endl;
+        return;
+    }
+    sem_unlink("/lab3_bench_queue_sem");
+
+    typedef cplib::SpscRing<Message, RingSize> Spsc;
+    typedef cplib::SpscRing<Message, RingSize, true> SpscBlocking;
+    typedef cplib::MpmcRing<Message, RingSize> Mpmc;
+    typedef cplib::MpmcRing<Message, RingSize, true> MpmcBlocking;
+
+    for (size_t batch : {size_t(1), size_t(32)}) {
+        runRingCase<SemQueue>("semaphore", 1, 1, messages, batch);
+        runRingCase<SpinQueue<Spsc>>("spsc", 1, 1, messages, batch);
+        runRingCase<FutexQueue<SpscBlocking>>("spsc_futex", 1, 1, messages, batch);
+    }
+    for (size_t n : procs) {
+        if (n > 1) {
+            runRingCase<SemQueue>("semaphore", n, n, messages, 32);
+        }
+        runRingCase<SpinQueue<Mpmc>>("mpmc", n, n, messages, 32);
+        runRingCase<FutexQueue<MpmcBlocking>>("mpmc_futex", n, n, messages, 32);
+    }
+    sem_close(g_queue_sem);
+}
+
+// ---------------- seqlock ----------------
+
+// писатель всегда пишет во все поля одно и то же значение
+struct SeqData {
+    long long fields[8];
+};
+
+struct SeqStats {
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> go;
+    std::atomic<uint32_t> stop;
+    std::atomic<uint64_t> reads;
+    std::atomic<uint64_t> torn;
+    std::atomic<uint64_t> writes;
+};
+
+static void runSeqlockCase(bool seqlock, size_t readers, double seconds) {
+    cplib::SharedMem<SeqData> shm("lab3_bench_seqlock");
+    cplib::SharedMem<SeqStats> stats("lab3_bench_seqlock_stats");
+    SeqStats* st = stats.Data();
+    if (shm.Data() == nullptr || st == nullptr) {
+        std::cerr << "Cannot create shared memory for seqlock" << std::endl;
+        return;
+    }
+
+    std::vector<pid_t> pids = forkWorkers(readers, [&](size_t) {
+        st->ready.fetch_add(1);
+        while (st->go.load() == 0) {
+            sched_yield();
+        }
+        uint64_t reads = 0;
+        uint64_t torn = 0;
+        SeqData copy;
+        while (st->stop.load(std::memory_order_relaxed) == 0) {
+            if (seqlock) {
+                shm.Read(copy);
+            } else {
+                shm.Lock();
+                copy = *shm.Data();
+                shm.Unlock();
+            }
+            for (int i = 1; i < 8; i++) {
+                if (copy.fields[i] != copy.fields[0]) {
+                    torn++;
+                    break;
+                }
+            }
+            reads++;
+        }
+        st->reads.fetch_add(reads);
+        st->torn.fetch_add(torn);
+    });
+    std::vector<pid_t> writer = forkWorkers(1, [&](size_t) {
+        st->ready.fetch_add(1);
+        while (st->go.load() == 0) {
+            sched_yield();
+        }
+        long long value = 0;
+        while (st->stop.load(std::memory_order_relaxed) == 0) {
+            shm.Lock();
+            value++;
+            for (int i = 0; i < 8; i++) {
+                shm.Data()->fields[i] = value;
+            }
+            shm.Unlock();
+            // писатель редкий по сравнению с читателями, как счетчик в приложении
+            usleep(100);
+        }
+        st->writes.store(static_cast<uint64_t>(value));
+    });
+    pids.insert(pids.end(), writer.begin(), writer.end());
+
+    while (st->ready.load() < readers + 1) {
+        sched_yield();
+    }
+    long long begin = monotonicNs();
+    st->go.store(1);
+    usleep(static_cast<useconds_t>(seconds * 1e6));
+    st->stop.store(1);
+    waitWorkers(pids);
+    double elapsed = (monotonicNs() - begin) / 1e9;
+
+    std::ostringstream line;
+    line << "{\"case\":\"seqlock\",\"read\":\"" << (seqlock ? "seqlock" : "lock") << "\""
+         << ",\"readers\":" << readers
+         << ",\"reads_per_sec\":" << st->reads.load() / elapsed
+         << ",\"torn\":" << st->torn.load()
+         << ",\"writes\":" << st->writes.load()
+         << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runSeqlock(const std::vector<size_t>& procs, double seconds) {
+    for (size_t n : procs) {
+        runSeqlockCase(false, n, seconds);
+        runSeqlockCase(true, n, seconds);
+    }
+}
+
+// ---------------- lock ----------------
+
+struct LockData {
+    long long counter;
+};
+
+static void runLockCase(bool semaphore, size_t procs, size_t iterations) {
+    cplib::SharedMem<LockData> shm("lab3_bench_lock");
+    cplib::SharedMem<SeqStats> stats("lab3_bench_lock_stats");
+    SeqStats* st = stats.Data();
+    sem_t* sem = sem_open("/lab3_bench_lock_sem", O_CREAT, 0600, 1);
+    if (shm.Data() == nullptr || st == nullptr || sem == SEM_FAILED) {
+        std::cerr << "Cannot create shared memory for lock" << std::endl;
+        return;
+    }
+    sem_unlink("/lab3_bench_lock_sem");
+
+    std::vector<pid_t> pids = forkWorkers(procs, [&](size_t) {
+        st->ready.fetch_add(1);
+        while (st->go.load() == 0) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < iterations; i++) {
+            if (semaphore) {
+                sem_wait(sem);
+                shm.Data()->counter++;
+                sem_post(sem);
+            } else {
+                shm.Lock();
+                shm.Data()->counter++;
+                shm.Unlock();
+            }
+        }
+    });
+    while (st->ready.load() < procs) {
+        sched_yield();
+    }
+    long long begin = monotonicNs();
+    st->go.store(1);
+    waitWorkers(pids);
+    double elapsed = (monotonicNs() - begin) / 1e9;
+    long long expected = static_cast<long long>(procs * iterations);
+    long long lost = expected - shm.Data()->counter;
+
+    // владелец умирает, не отпустив блокировку
+    waitWorkers(forkWorkers(1, [&](size_t) {
+        if (semaphore) {
+            sem_wait(sem);
+        } else {
+            shm.Lock();
+        }
+    }));
+    long long t0 = monotonicNs();
+    bool recovered;
+    if (semaphore) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        recovered = sem_timedwait(sem, &deadline) == 0;
+    } else {
+        recovered = shm.Lock() == cplib::LOCK_OWNER_DIED;
+        shm.Unlock();
+    }
+    double recoveryUs = (monotonicNs() - t0) / 1000.0;
+    sem_close(sem);
+
+    std::ostringstream line;
+    line << "{\"case\":\"lock\",\"lock\":\"" << (semaphore ? "semaphore" : "shared_mutex") << "\""
+         << ",\"procs\":" << procs
+         << ",\"ops_per_sec\":" << expected / elapsed
+         << ",\"ns_per_op\":" << elapsed * 1e9 / expected
+         << ",\"lost\":" << lost
+         << ",\"recovered\":" << (recovered ? "true" : "false")
+         << ",\"recovery_us\":" << recoveryUs
+         << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runLock(const std::vector<size_t>& procs, size_t iterations) {
+    for (size_t n : procs) {
+        runLockCase(true, n, iterations);
+        runLockCase(false, n, iterations);
+    }
+}
+
+// ---------------- atomic ----------------
+
+enum AtomicMode { ATOMIC_LOCKED, ATOMIC_FETCH_ADD, ATOMIC_CAS };
+
+static void runAtomicCase(AtomicMode mode, size_t procs, size_t iterations) {
+    static const char* const names[] = {"locked", "fetch_add", "cas_update"};
+    cplib::SharedMem<LockData> shm("lab3_bench_atomic");
+    cplib::SharedMem<SeqStats> stats("lab3_bench_atomic_stats");
+    SeqStats* st = stats.Data();
+    if (shm.Data() == nullptr || st == nullptr) {
+        std::cerr << "Cannot create shared memory for atomic" << std::endl;
+        return;
+    }
+
+    std::vector<pid_t> pids = forkWorkers(procs, [&](size_t) {
+        st->ready.fetch_add(1);
+        while (st->go.load() == 0) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < iterations; i++) {
+            switch (mode) {
+            case ATOMIC_LOCKED:
+                shm.Lock();
+                shm.Data()->counter++;
+                shm.Unlock();
+                break;
+            case ATOMIC_FETCH_ADD:
+                shm.FetchAdd(&LockData::counter, 1LL);
+                break;
+            case ATOMIC_CAS:
+                shm.Update(&LockData::counter, [](long long v) { return v + 1; });
+                break;
+            }
+        }
+    });
+    while (st->ready.load() < procs) {
+        sched_yield();
+    }
+    long long begin = monotonicNs();
+    st->go.store(1);
+    waitWorkers(pids);
+    double elapsed = (monotonicNs() - begin) / 1e9;
+    long long expected = static_cast<long long>(procs * iterations);
+
+    std::ostringstream line;
+    line << "{\"case\":\"atomic\",\"op\":\"" << names[mode] << "\""
+         << ",\"procs\":" << procs
+         << ",\"incs_per_sec\":" << expected / elapsed
+         << ",\"ns_per_inc\":" << elapsed * 1e9 / expected
+         << ",\"lost\":" << expected - shm.Load(&LockData::counter)
+         << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runAtomic(const std::vector<size_t>& procs, size_t iterations) {
+    for (size_t n : procs) {
+        runAtomicCase(ATOMIC_LOCKED, n, iterations);
+        runAtomicCase(ATOMIC_FETCH_ADD, n, iterations);
+        runAtomicCase(ATOMIC_CAS, n, iterations);
+    }
+}
+
+// ---------------- striped ----------------
+
+enum StripeMode { STRIPE_SHARED, STRIPE_PACKED, STRIPE_STRIPED };
+
+struct StripeData {
+    long long shared;
+    long long packed[64];
+    cplib::StripedCounter<> striped;
+};
+
+static void runStripedCase(StripeMode mode, size_t procs, size_t iterations) {
+    static const char* const names[] = {"shared", "packed", "striped"};
+    cplib::SharedMem<StripeData> shm("lab3_bench_striped");
+    cplib::SharedMem<SeqStats> stats("lab3_bench_striped_stats");
+    StripeData* data = shm.Data();
+    SeqStats* st = stats.Data();
+    if (data == nullptr || st == nullptr) {
+        std::cerr << "Cannot create shared memory for striped" << std::endl;
+        return;
+    }
+
+    std::vector<pid_t> pids = forkWorkers(procs, [&](size_t w) {
+        st->ready.fetch_add(1);
+        while (st->go.load() == 0) {
+            sched_yield();
+        }
+        long long* own = &data->packed[w % 64];
+        for (size_t i = 0; i < iterations; i++) {
+            switch (mode) {
+            case STRIPE_SHARED:
+                __atomic_fetch_add(&data->shared, 1LL, __ATOMIC_RELAXED);
+                break;
+            case STRIPE_PACKED:
+                __atomic_fetch_add(own, 1LL, __ATOMIC_RELAXED);
+                break;
+            case STRIPE_STRIPED:
+                data->striped.Add();
+                break;
+            }
+        }
+    });
+    while (st->ready.load() < procs) {
+        sched_yield();
+    }
+    long long begin = monotonicNs();
+    st->go.store(1);
+    waitWorkers(pids);
+    double elapsed = (monotonicNs() - begin) / 1e9;
+    long long expected = static_cast<long long>(procs * iterations);
+
+    long long total = data->shared + data->striped.Sum();
+    for (long long v : data->packed) {
+        total += v;
+    }
+    std::ostringstream line;
+    line << "{\"case\":\"striped\",\"op\":\"" << names[mode] << "\""
+         << ",\"procs\":" << procs
+         << ",\"incs_per_sec\":" << expected / elapsed
+         << ",\"ns_per_inc\":" << elapsed * 1e9 / expected
+         << ",\"lost\":" << expected - total
+         << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runStriped(const std::vector<size_t>& procs, size_t iterations) {
+    for (size_t n : procs) {
+        runStripedCase(STRIPE_SHARED, n, iterations);
+        runStripedCase(STRIPE_PACKED, n, iterations);
+        runStripedCase(STRIPE_STRIPED, n, iterations);
+    }
+}
+
+// ---------------- notify ----------------
+
+static void runNotifyCase(bool futex, size_t rounds) {
+    cplib::SharedMem<LockData> shm("lab3_bench_notify");
+    if (shm.Data() == nullptr) {
+        std::cerr << "Cannot create shared memory for notify" << std::endl;
+        return;
+    }
+    // дождаться, пока поле станет value
+    auto waitFor = [&](long long value) {
+        if (futex) {
+            shm.WaitUntil([&] { return shm.Load(&LockData::counter) == value; });
+        } else {
+            while (shm.Load(&LockData::counter) != value) {
+                struct timespec t = {0, 1000000};
+                nanosleep(&t, nullptr);
+            }
+        }
+    };
+
+    // нечетные пишет родитель, четные - отвечающий процесс
+    std::vector<pid_t> pids = forkWorkers(1, [&](size_t) {
+        for (size_t i = 1; i <= rounds; i++) {
+            waitFor(2 * i - 1);
+            shm.Store(&LockData::counter, static_cast<long long>(2 * i));
+        }
+    });
+    std::vector<double> us;
+    us.reserve(rounds);
+    for (size_t i = 1; i <= rounds; i++) {
+        long long begin = monotonicNs();
+        shm.Store(&LockData::counter, static_cast<long long>(2 * i - 1));
+        waitFor(2 * i);
+        us.push_back((monotonicNs() - begin) / 2e3);
+    }
+    waitWorkers(pids);
+
+    std::ostringstream line;
+    line << "{\"case\":\"notify\",\"mode\":\"" << (futex ? "wait_change" : "sleep_poll") << "\""
+         << ",\"rounds\":" << rounds;
+    printStats(line, "oneway", us);
+    line << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runNotify(size_t rounds) {
+    runNotifyCase(false, rounds);
+    runNotifyCase(true, rounds);
+}
+
+// ---------------- mapping ----------------
+
+struct BigData {
+    unsigned char bytes[64 << 20];
+};
+
+static double passMs(const BigData* data, unsigned long long& sum) {
+    long long begin = monotonicNs();
+    for (size_t i = 0; i < sizeof(data->bytes); i += 64) {
+        sum += data->bytes[i];
+    }
+    return (monotonicNs() - begin) / 1e6;
+}
+
+static void runMapping() {
+    static const struct { const char* name; int options; } modes[] = {
+        {"default", cplib::SHMEM_DEFAULT},
+        {"prefault", cplib::SHMEM_PREFAULT},
+        {"huge_prefault", cplib::SHMEM_HUGE_PAGES | cplib::SHMEM_PREFAULT},
+        {"lock", cplib::SHMEM_LOCK},
+    };
+    // создатель заполняет сегмент конструктором T, страницы уже есть в tmpfs;
+    // меряем, во что обходится подключиться к ним другому процессу
+    cplib::SharedMem<BigData> owner("lab3_bench_mapping");
+    if (owner.Data() == nullptr) {
+        std::cerr << "Cannot create shared memory for mapping" << std::endl;
+        return;
+    }
+    for (const auto& mode : modes) {
+        waitWorkers(forkWorkers(1, [&](size_t) {
+            long long begin = monotonicNs();
+            cplib::SharedMem<BigData> shm("lab3_bench_mapping", false, mode.options);
+            double openMs = (monotonicNs() - begin) / 1e6;
+            if (shm.Data() == nullptr) {
+                std::cerr << "Cannot open shared memory for mapping" << std::endl;
+                return;
+            }
+            unsigned long long sum = 0;
+            double first = passMs(shm.Data(), sum);
+            double second = passMs(shm.Data(), sum);
+
+            std::ostringstream line;
+            line << "{\"case\":\"mapping\",\"mode\":\"" << mode.name << "\""
+                 << ",\"open_ms\":" << openMs
+                 << ",\"first_pass_ms\":" << first
+                 << ",\"second_pass_ms\":" << second
+                 << ",\"applied\":" << shm.AppliedOptions()
+                 << ",\"sum\":" << sum
+                 << "}";
+            std::cout << line.str() << std::endl;
+        }));
+    }
+}
+
+// ---------------- hash ----------------
+
+typedef cplib::ShmHashTable<long long, 16384> BenchTable;
+
+static void runHashCase(bool mixed, size_t procs, size_t iterations) {
+    const size_t keyCount = 12000;
+    cplib::SharedMem<BenchTable> shm("lab3_bench_hash");
+    cplib::SharedMem<SeqStats> stats("lab3_bench_hash_stats");
+    BenchTable* table = shm.Data();
+    SeqStats* st = stats.Data();
+    if (table == nullptr || st == nullptr) {
+        std::cerr << "Cannot create shared memory for hash" << std::endl;
+        return;
+    }
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < keyCount; i++) {
+        keys.push_back("counter." + std::to_string(i));
+        table->Insert(keys.back().c_str(), 0);
+    }
+
+    std::vector<pid_t> pids = forkWorkers(procs, [&](size_t w) {
+        unsigned long long x = 88172645463325252ULL + w;
+        uint64_t found = 0;
+        uint64_t updates = 0;
+        st->ready.fetch_add(1);
+        while (st->go.load() == 0) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < iterations; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            const char* key = keys[x % keyCount].c_str();
+            if (mixed && x % 10 == 0) {
+                updates += table->Update(key, [](long long& v) { v++; }, false);
+            } else {
+                long long value;
+                found += table->Find(key, value);
+            }
+        }
+        st->writes.fetch_add(updates);
+        st->reads.fetch_add(found);
+    });
+    while (st->ready.load() < procs) {
+        sched_yield();
+    }
+    long long begin = monotonicNs();
+    st->go.store(1);
+    waitWorkers(pids);
+    double elapsed = (monotonicNs() - begin) / 1e9;
+    long long ops = static_cast<long long>(procs * iterations);
+    long long updates = static_cast<long long>(st->writes.load());
+    long long found = static_cast<long long>(st->reads.load());
+
+    long long sum = 0;
+    table->ForEach([&](const char*, long long value) { sum += value; });
+    cplib::ShmHashStats hs = table->Stats();
+    std::ostringstream line;
+    line << "{\"case\":\"hash\",\"op\":\"" << (mixed ? "mixed" : "lookup") << "\""
+         << ",\"procs\":" << procs
+         << ",\"ops_per_sec\":" << ops / elapsed
+         << ",\"ns_per_op\":" << elapsed * 1e9 / ops
+         << ",\"missed\":" << ops - updates - found
+         << ",\"lost\":" << updates - sum
+         << ",\"size\":" << hs.size
+         << ",\"load_factor\":" << hs.load_factor
+         << ",\"mean_probe\":" << hs.mean_probe
+         << ",\"max_probe\":" << hs.max_probe
+         << "}";
+    std::cout << line.str() << std::endl;
+}
+
+static void runHash(const std::vector<size_t>& procs, size_t iterations) {
+    for (size_t n : procs) {
+        runHashCase(false, n, iterations);
+        runHashCase(true, n, iterations);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string caseList = "ring,seqlock,lock,atomic,striped,notify,mapping,hash";
+    size_t messages = 1000000;
+    std::string procList = "1,2,4";
+    double seconds = 0.5;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "--cases") {
+            caseList = argv[i + 1];
+        } else if (opt == "--messages") {
+            messages = static_cast<size_t>(atol(argv[i + 1]));
+        } else if (opt == "--procs") {
+            procList = argv[i + 1];
+        } else if (opt == "--seconds") {
+            seconds = atof(argv[i + 1]);
+        } else {
+            std::cerr << "Unknown option: " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<size_t> procs;
+    for (const auto& p : splitList(procList)) {
+        procs.push_back(std::max<size_t>(1, static_cast<size_t>(atol(p.c_str()))));
+    }
+
+    for (const auto& name : splitList(caseList)) {
+        if (name == "ring") {
+            runRing(messages, procs);
+        } else if (name == "seqlock") {
+            runSeqlock(procs, seconds);
+        } else if (name == "lock") {
+            runLock(procs, std::max<size_t>(1, messages / 10));
+        } else if (name == "atomic") {
+            runAtomic(procs, std::max<size_t>(1, messages / 10));
+        } else if (name == "striped") {
+            runStriped(procs, std::max<size_t>(1, messages / 10));
+        } else if (name == "notify") {
+            runNotify(std::max<size_t>(1, messages / 5000));
+        } else if (name == "mapping") {
+            runMapping();
+        } else if (name == "hash") {
+            runHash(procs, messages);
+        } else {
+            std::cerr << "Unknown case: " << name << std::endl;
+        }
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+// Ожидание на слове в разделяемой памяти (Linux futex). Без FUTEX_PRIVATE_FLAG:
+// ждущий и будящий могут быть в разных процессах, лишь бы слово лежало в общем сегменте
+
+#if !defined (WIN32)
+
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+
+namespace cplib
+{
+	// Спать, пока *word == expected и никто не разбудил. timeout < 0 - без ограничения.
+	// true - разбудили (или значение уже другое), false - таймаут
+	inline bool FutexWait(std::atomic<uint32_t>* word, uint32_t expected, double timeout = -1.0) {
+		struct timespec ts;
+		struct timespec* pts = NULL;
+		if (timeout >= 0.0) {
+			ts.tv_sec = (time_t)timeout;
+			ts.tv_nsec = (long)((timeout - ts.tv_sec) * 1e9);
+			pts = &ts;
+		}
+		long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, pts, NULL, 0);
+		return !(ret != 0 && errno == ETIMEDOUT);
+	}
+	// Разбудить до count ждущих, вернуть сколько разбудили
+	inline int FutexWake(std::atomic<uint32_t>* word, int count = 1) {
+		return (int)syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, count, NULL, NULL, 0);
+	}
+}
+
+#endif // WIN32
@@ -1,5 +1,10 @@
 #include "shmem.hpp" // либы из code examples
 #include "mutex.hpp"
+#if !defined(_WIN32)
+#include "shmarena.hpp"
+#include "shmcounter.hpp"
+#include "shmhash.hpp"
+#endif
 
 #include <iostream>
 #include <fstream>
@@ -11,6 +16,8 @@
 #include <string>
 #include <algorithm>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <cstring>
 
 #if defined(_WIN32)
@@ -28,9 +35,16 @@
     #include <errno.h>
 #endif
 
+// counter меняют все процессы по таймеру, остальное пишется при старте и раз в несколько
+// секунд. Поэтому горячее и холодное лежат в разных строках кэша (64 байта): иначе каждое
+// увеличение counter выбивает из кэша строку с флагами и pid у всех, кто их читает
 struct SharedData {
-    int counter;
-    bool is_master;
+    alignas(64) int counter;
+#if !defined(_WIN32)
+    // сколько раз таймеры всех процессов увеличили counter; у каждого ядра своя строка
+    cplib::StripedCounter<> ticks;
+#endif
+    alignas(64) bool is_master;
     pid_t master_pid;
     time_t last_fork_time;
     pid_t child1_pid;
@@ -47,6 +61,33 @@ std::atomic<bool> g_is_master(false);
 std::atomic<bool> g_is_child(false);
 std::atomic<int> g_child_type(0); // 0 = master, 1 = child1, 2 = child2
 cplib::Mutex g_log_mutex;
+#if !defined(_WIN32)
+// Заметки, общие для всех копий приложения: строки переменной длины в арене
+cplib::SharedArena* g_arena = nullptr;
+cplib::ShmVector<cplib::ShmString>* g_notes = nullptr;
+// Именованные счетчики всех копий приложения
+typedef cplib::ShmHashTable<long long, 4096> NamedCounters;
+cplib::SharedMem<NamedCounters>* g_named = nullptr;
+#endif
+
+// Остановка приложения. Потоки ждут ее на своей условной переменной, а не на сегменте:
+// там их будил бы каждый FetchAdd таймеров всех копий приложения
+std::mutex g_stop_mutex;
+std::condition_variable g_stop_cv;
+
+void request_stop() {
+    {
+        std::lock_guard<std::mutex> lock(g_stop_mutex);
+        g_running = false;
+    }
+    g_stop_cv.notify_all();
+}
+
+// Пауза между итерациями потока: request_stop() будит сразу, а не через остаток периода
+void wait_period(double seconds) {
+    std::unique_lock<std::mutex> lock(g_stop_mutex);
+    g_stop_cv.wait_for(lock, std::chrono::duration<double>(seconds), [] { return !g_running; });
+}
 
 std::string get_current_time_string(bool with_ms = false) {
     auto now = std::chrono::system_clock::now();
@@ -112,17 +153,13 @@ void run_child1() {
         return;
     }
     
-    local_shared_mem.Lock();
-    SharedData* data = local_shared_mem.Data();
-    if (data) {
-        data->counter += 10;
-        child_log_file << get_current_time_string(true) << " [PID: " << getpid() 
-                       << " Child1] Added 10 to counter. New value: " << data->counter << std::endl;
-        child_log_file.flush();
-        std::cout << get_current_time_string(true) << " [PID: " << getpid() 
-                  << " Child1] Added 10 to counter. New value: " << data->counter << std::endl;
-    }
-    local_shared_mem.Unlock();
+    // одно поле - атомарно, без блокировки всего сегмента
+    int value = local_shared_mem.FetchAdd(&SharedData::counter, 10) + 10;
+    child_log_file << get_current_time_string(true) << " [PID: " << getpid() 
+                   << " Child1] Added 10 to counter. New value: " << value << std::endl;
+    child_log_file.flush();
+    std::cout << get_current_time_string(true) << " [PID: " << getpid() 
+              << " Child1] Added 10 to counter. New value: " << value << std::endl;
     
 #if defined(_WIN32)
     if (g_shared_mem && g_shared_mem->IsValid()) {
@@ -168,19 +205,12 @@ void run_child2() {
         return;
     }
     
-    local_shared_mem.Lock();
-    SharedData* data = local_shared_mem.Data();
-    //int original_value = 0;
-    if (data) {
-        //original_value = data->counter;
-        data->counter *= 2;
-        child_log_file << get_current_time_string(true) << " [PID: " << getpid() 
-                       << " Child2] Multiplied counter by 2. New value: " << data->counter << std::endl;
-        child_log_file.flush();
-        std::cout << get_current_time_string(true) << " [PID: " << getpid() 
-                  << " Child2] Multiplied counter by 2. New value: " << data->counter << std::endl;
-    }
-    local_shared_mem.Unlock();
+    int value = local_shared_mem.Update(&SharedData::counter, [](int v) { return v * 2; });
+    child_log_file << get_current_time_string(true) << " [PID: " << getpid() 
+                   << " Child2] Multiplied counter by 2. New value: " << value << std::endl;
+    child_log_file.flush();
+    std::cout << get_current_time_string(true) << " [PID: " << getpid() 
+              << " Child2] Multiplied counter by 2. New value: " << value << std::endl;
     
 #if defined(_WIN32)
     Sleep(2000);
@@ -188,18 +218,12 @@ void run_child2() {
     sleep(2);
 #endif
     
-    local_shared_mem.Lock();
-    data = local_shared_mem.Data();
-    if (data) {
-        //data->counter = original_value;
-        data->counter /= 2;
-        child_log_file << get_current_time_string(true) << " [PID: " << getpid() 
-                       << " Child2] Divided counter by 2. Restored value: " << data->counter << std::endl;
-        child_log_file.flush();
-        std::cout << get_current_time_string(true) << " [PID: " << getpid() 
-                  << " Child2] Divided counter by 2. Restored value: " << data->counter << std::endl;
-    }
-    local_shared_mem.Unlock();
+    value = local_shared_mem.Update(&SharedData::counter, [](int v) { return v / 2; });
+    child_log_file << get_current_time_string(true) << " [PID: " << getpid() 
+                   << " Child2] Divided counter by 2. Restored value: " << value << std::endl;
+    child_log_file.flush();
+    std::cout << get_current_time_string(true) << " [PID: " << getpid() 
+              << " Child2] Divided counter by 2. Restored value: " << value << std::endl;
     
 #if defined(_WIN32)
     if (g_shared_mem && g_shared_mem->IsValid()) {
@@ -229,19 +253,17 @@ private:
 protected:
     virtual void Main() override {
         while (true) {
-            cplib::Thread::Sleep(0.3);
+            wait_period(0.3);
             
             CancelPoint();
             
             if (!g_running) break;
             
             if (m_shared_mem && m_shared_mem->IsValid()) {
-                m_shared_mem->Lock();
-                SharedData* data = m_shared_mem->Data();
-                if (data) {
-                    data->counter++;
-                }
-                m_shared_mem->Unlock();
+                m_shared_mem->FetchAdd(&SharedData::counter, 1);
+#if !defined(_WIN32)
+                m_shared_mem->Data()->ticks.Add();
+#endif
             }
         }
     }
@@ -263,26 +285,27 @@ private:
 protected:
     virtual void Main() override {
         while (true) {
-            cplib::Thread::Sleep(1.0);
+            wait_period(1.0);
             
             CancelPoint();
             
             if (!g_running) break;
             
             if (m_shared_mem && m_shared_mem->IsValid()) {
-                m_shared_mem->Lock();
-                SharedData* data = m_shared_mem->Data();
-                if (data) {
-                    cplib::AutoMutex lock(*m_log_mutex);
-                    if (m_log_file->is_open()) {
-                        *m_log_file << get_current_time_string(true) << " [PID: " << getpid() 
-                                   << " Master] Counter = " << data->counter << std::endl;
-                        m_log_file->flush();
-                    }
-                    std::cout << get_current_time_string(true) << " [PID: " << getpid() 
-                             << " Master] Counter = " << data->counter << std::endl;
+                // только читаем - семафор не трогаем
+                SharedData data = m_shared_mem->Snapshot();
+                std::string line = "Counter = " + std::to_string(data.counter);
+#if !defined(_WIN32)
+                line += ", timer ticks = " + std::to_string(data.ticks.Sum());
+#endif
+                cplib::AutoMutex lock(*m_log_mutex);
+                if (m_log_file->is_open()) {
+                    *m_log_file << get_current_time_string(true) << " [PID: " << getpid() 
+                               << " Master] " << line << std::endl;
+                    m_log_file->flush();
                 }
-                m_shared_mem->Unlock();
+                std::cout << get_current_time_string(true) << " [PID: " << getpid() 
+                         << " Master] " << line << std::endl;
             }
         }
     }
@@ -365,7 +388,7 @@ private:
 protected:
     virtual void Main() override {
         while (true) {
-            cplib::Thread::Sleep(3.0);
+            wait_period(3.0);
             
             CancelPoint();
             
@@ -537,6 +560,11 @@ void handle_user_input() {
     std::cout << "\nCommands:" << std::endl;
     std::cout << "  set <value>  - Set counter value" << std::endl;
     std::cout << "  get          - Get current counter value" << std::endl;
+    std::cout << "  wait         - Wait until the counter changes (up to 10 s)" << std::endl;
+    std::cout << "  note <text>  - Add a note shared with all instances" << std::endl;
+    std::cout << "  notes        - Show shared notes" << std::endl;
+    std::cout << "  inc <name> [n] - Add n (default 1) to a named shared counter" << std::endl;
+    std::cout << "  counters     - Show named shared counters" << std::endl;
     std::cout << "  exit         - Exit application" << std::endl;
     std::cout << "  help         - Show this help" << std::endl;
     std::cout << "================================\n" << std::endl;
@@ -553,12 +581,20 @@ void handle_user_input() {
             break;
         } else if (command == "get") {
             if (g_shared_mem && g_shared_mem->IsValid()) {
-                g_shared_mem->Lock();
-                SharedData* data = g_shared_mem->Data();
-                if (data) {
-                    std::cout << "Current counter value: " << data->counter << std::endl;
+                std::cout << "Current counter value: " << g_shared_mem->Snapshot().counter << std::endl;
+            } else {
+                std::cout << "Shared memory not available" << std::endl;
+            }
+        } else if (command == "wait") {
+            if (g_shared_mem && g_shared_mem->IsValid()) {
+                // спим до изменения любым процессом, без опроса
+                int old = g_shared_mem->Load(&SharedData::counter);
+                if (g_shared_mem->WaitChange(&SharedData::counter, old, 10.0)) {
+                    std::cout << "Counter changed: " << old << " -> "
+                              << g_shared_mem->Load(&SharedData::counter) << std::endl;
+                } else {
+                    std::cout << "Counter did not change in 10 s" << std::endl;
                 }
-                g_shared_mem->Unlock();
             } else {
                 std::cout << "Shared memory not available" << std::endl;
             }
@@ -566,23 +602,78 @@ void handle_user_input() {
             try {
                 int value = std::stoi(command.substr(4));
                 if (g_shared_mem && g_shared_mem->IsValid()) {
-                    g_shared_mem->Lock();
-                    SharedData* data = g_shared_mem->Data();
-                    if (data) {
-                        data->counter = value;
-                        std::cout << "Counter set to: " << value << std::endl;
-                        log_message("User set counter to " + std::to_string(value));
-                    }
-                    g_shared_mem->Unlock();
+                    g_shared_mem->Store(&SharedData::counter, value);
+                    std::cout << "Counter set to: " << value << std::endl;
+                    log_message("User set counter to " + std::to_string(value));
                 }
             } catch (const std::exception& e) {
                 std::cout << "Invalid value: " << e.what() << std::endl;
             }
         
+#if !defined(_WIN32)
+        } else if (command.substr(0, 5) == "note ") {
+            if (g_notes) {
+                std::string note = "[" + std::to_string(getpid()) + "] " + command.substr(5);
+                g_arena->Lock();
+                bool added = g_notes->EmplaceBack(note);
+                g_arena->Unlock();
+                std::cout << (added ? "Note added" : "Shared arena is full") << std::endl;
+            } else {
+                std::cout << "Shared arena not available" << std::endl;
+            }
+        } else if (command.substr(0, 4) == "inc ") {
+            std::istringstream args(command.substr(4));
+            std::string name;
+            long long delta = 1;
+            args >> name >> delta;
+            if (!g_named || !g_named->IsValid()) {
+                std::cout << "Named counters not available" << std::endl;
+            } else if (name.empty()) {
+                std::cout << "Usage: inc <name> [n]" << std::endl;
+            } else {
+                long long value = 0;
+                bool ok = g_named->Data()->Update(name.c_str(), [&](long long& v) { v += delta; value = v; });
+                if (ok) {
+                    std::cout << name << " = " << value << std::endl;
+                } else {
+                    std::cout << "Name is longer than " << NamedCounters::MaxKey
+                              << " characters or the table is full" << std::endl;
+                }
+            }
+        } else if (command == "counters") {
+            if (g_named && g_named->IsValid()) {
+                const NamedCounters* table = g_named->Data();
+                table->ForEach([](const char* name, long long value) {
+                    std::cout << "  " << name << " = " << value << std::endl;
+                });
+                cplib::ShmHashStats stats = table->Stats();
+                std::cout << stats.size << " counter(s), load factor " << stats.load_factor
+                          << ", mean probe " << stats.mean_probe << ", max probe " << stats.max_probe << std::endl;
+            } else {
+                std::cout << "Named counters not available" << std::endl;
+            }
+        } else if (command == "notes") {
+            if (g_notes) {
+                g_arena->Lock();
+                for (const cplib::ShmString& note : *g_notes) {
+                    std::cout << "  " << note.CStr() << std::endl;
+                }
+                std::cout << g_notes->Size() << " note(s), arena " << g_arena->Used() << "/"
+                          << g_arena->Size() << " bytes" << std::endl;
+                g_arena->Unlock();
+            } else {
+                std::cout << "Shared arena not available" << std::endl;
+            }
+#endif
         } else if (command == "help") {
             std::cout << "\nCommands:" << std::endl;
             std::cout << "  set <value>  - Set counter value" << std::endl;
             std::cout << "  get          - Get current counter value" << std::endl;
+            std::cout << "  wait         - Wait until the counter changes (up to 10 s)" << std::endl;
+            std::cout << "  note <text>  - Add a note shared with all instances" << std::endl;
+            std::cout << "  notes        - Show shared notes" << std::endl;
+            std::cout << "  inc <name> [n] - Add n (default 1) to a named shared counter" << std::endl;
+            std::cout << "  counters     - Show named shared counters" << std::endl;
             std::cout << "  exit         - Exit application" << std::endl;
             std::cout << "  help         - Show this help" << std::endl;
 
@@ -628,7 +719,24 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    g_shared_mem->Lock();
+#if !defined(_WIN32)
+    g_arena = new cplib::SharedArena("counter_app_arena", 16 << 20);
+    if (g_arena->IsValid()) {
+        g_notes = g_arena->FindOrConstruct<cplib::ShmVector<cplib::ShmString>>("notes");
+    }
+    if (!g_notes) {
+        log_message("Shared arena is not available, notes are disabled");
+    }
+    g_named = new cplib::SharedMem<NamedCounters>("counter_app_named", true);
+    if (!g_named->IsValid()) {
+        log_message("Named counters are not available");
+    }
+#endif
+
+    if (g_shared_mem->Lock() == cplib::LOCK_OWNER_DIED) {
+        // блокировка не потеряна навсегда: процесс умер, держа ее, и теперь она наша
+        log_message("Previous lock holder died, shared data taken over as is");
+    }
     SharedData* shared_data = g_shared_mem->Data();
     
     bool master_exists = false;
@@ -695,7 +803,7 @@ int main(int argc, char* argv[]) {
         
         handle_user_input();
         
-        g_running = false;
+        request_stop();
         timer_thread->Stop();
         log_thread->Stop();
         fork_thread->Stop();
@@ -717,7 +825,7 @@ int main(int argc, char* argv[]) {
         
         handle_user_input();
         
-        g_running = false;
+        request_stop();
         timer_thread->Stop();
         timer_thread->Join(1.0);
         
@@ -742,6 +850,13 @@ int main(int argc, char* argv[]) {
         delete g_shared_mem;
         g_shared_mem = nullptr;
     }
+#if !defined(_WIN32)
+    g_notes = nullptr;
+    delete g_arena;
+    g_arena = nullptr;
+    delete g_named;
+    g_named = nullptr;
+#endif
     
     return 0;
 }
\ No newline at end of file
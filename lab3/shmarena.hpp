@@ -0,0 +1,681 @@
+#pragma once
+
+// Растущая арена в разделяемой памяти и контейнеры поверх нее.
+// SharedMem<T> отображает ровно sizeof(T), поэтому std::string и std::vector в нем
+// между процессами не работают: их указатели смотрят в кучу одного процесса.
+// Здесь память выделяется внутри сегмента, а ссылки хранятся смещениями (OffsetPtr),
+// так что структуры данных одинаково читаются во всех процессах.
+
+#if !defined (WIN32)
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>          /* ftruncate() */
+#include <atomic>
+#include <new>               /* placement new */
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include "shmmutex.hpp"
+
+namespace cplib
+{
+	// Указатель, хранящий смещение от собственного адреса. В каждом процессе сегмент
+	// отображен по своему адресу, но взаимное расположение объектов в нем одинаковое.
+	// Сам OffsetPtr должен лежать в том же сегменте, что и объект, на который он указывает
+	template <class T> class OffsetPtr
+	{
+	public:
+		OffsetPtr() :_off(0) {}
+		OffsetPtr(T* ptr) { Set(ptr); }
+		OffsetPtr(const OffsetPtr& other) { Set(other.Get()); }
+		OffsetPtr& operator=(const OffsetPtr& other) { Set(other.Get()); return *this; }
+		OffsetPtr& operator=(T* ptr) { Set(ptr); return *this; }
+
+		T* Get() const {
+			if (_off == 0)
+				return NULL;
+			return reinterpret_cast<T*>(reinterpret_cast<intptr_t>(this) + _off);
+		}
+		T* operator->() const { return Get(); }
+		T& operator*() const { return *Get(); }
+		explicit operator bool() const { return _off != 0; }
+	private:
+		void Set(T* ptr) {
+			// 0 - нулевой указатель: на самого себя OffsetPtr не указывает никогда
+			_off = (ptr == NULL) ? 0 : reinterpret_cast<intptr_t>(ptr) - reinterpret_cast<intptr_t>(this);
+		}
+		intptr_t _off;
+	};
+
+	// Арена в именованном сегменте. При подключении резервируется адресное пространство
+	// на max_size байт, а файл сегмента растет через ftruncate по мере выделения.
+	// Новые страницы сразу видны всем процессам, сегмент никуда не переезжает,
+	// поэтому обычные указатели внутрь арены в пределах процесса остаются верными.
+	//
+	// Выделение - блоки размером степень двойки со списками свободных блоков по классам.
+	// Само выделение защищено внутри, а данные контейнеров - нет: их меняют под Lock()
+	class SharedArena
+	{
+	public:
+		enum {
+			DefaultMaxSize = 256 << 20,
+			MaxRoots = 32,
+			RootNameSize = 48
+		};
+
+		SharedArena(const char* name, size_t max_size = DefaultMaxSize, bool create_if_not_exists = true)
+			:_fd(-1), _base(NULL), _max_size(0) {
+			_fname = std::string("/") + name;
+			bool is_new = false;
+			_fd = shm_open(_fname.c_str(), O_RDWR, 0644);
+			if (_fd < 0 && create_if_not_exists) {
+				_fd = shm_open(_fname.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+				if (_fd >= 0)
+					is_new = true;
+				else if (errno == EEXIST) // создали параллельно с нами
+					_fd = shm_open(_fname.c_str(), O_RDWR, 0644);
+			}
+			if (_fd < 0)
+				return;
+
+			bool ret = is_new ? Init(max_size) : Attach();
+			if (!ret) {
+				UnMap();
+				close(_fd);
+				_fd = -1;
+				if (is_new)
+					shm_unlink(_fname.c_str());
+				return;
+			}
+			Header()->cnt.fetch_add(1);
+			Register(this);
+		}
+		virtual ~SharedArena() {
+			if (!IsValid())
+				return;
+			Unregister(this);
+			bool last = Header()->cnt.fetch_sub(1) == 1;
+			UnMap();
+			close(_fd);
+			if (last)
+				shm_unlink(_fname.c_str());
+		}
+
+		bool IsValid() const { return _base != NULL; }
+
+		// Блок не меньше size байт, выровненный на 16. NULL - сегмент достиг max_size
+		void* Allocate(size_t size) {
+			if (!IsValid())
+				return NULL;
+			int cls = SizeClass(size + sizeof(Block));
+			if (cls < 0)
+				return NULL;
+			ArenaHeader* hdr = Header();
+			hdr->alloc_lock.Lock();
+			Block* block = NULL;
+			if (hdr->free_lists[cls] != 0) {
+				block = At<Block>(hdr->free_lists[cls]);
+				hdr->free_lists[cls] = block->next;
+			} else {
+				uint64_t bytes = ClassBytes(cls);
+				if (hdr->top + bytes > hdr->size.load() && !Grow(hdr->top + bytes)) {
+					hdr->alloc_lock.Unlock();
+					return NULL;
+				}
+				block = At<Block>(hdr->top);
+				hdr->top += bytes;
+			}
+			block->cls = cls;
+			block->tag = BlockTag;
+			block->next = 0;
+			hdr->used += ClassBytes(cls);
+			hdr->alloc_lock.Unlock();
+			return block + 1;
+		}
+		void Deallocate(void* ptr) {
+			if (ptr == NULL || !Contains(ptr))
+				return;
+			Block* block = reinterpret_cast<Block*>(ptr) - 1;
+			if (block->tag != BlockTag)
+				return;
+			ArenaHeader* hdr = Header();
+			hdr->alloc_lock.Lock();
+			block->tag = 0;
+			block->next = hdr->free_lists[block->cls];
+			hdr->free_lists[block->cls] = OffsetOf(block);
+			hdr->used -= ClassBytes(block->cls);
+			hdr->alloc_lock.Unlock();
+		}
+
+		// Именованный корневой объект арены, по которому его находят другие процессы
+		template <class T> T* Find(const char* name) {
+			if (!IsValid())
+				return NULL;
+			Header()->root_lock.Lock();
+			Root* root = FindRoot(name);
+			T* obj = (root != NULL) ? At<T>(root->off) : NULL;
+			Header()->root_lock.Unlock();
+			return obj;
+		}
+		// Найти или создать. Конструктор T выполняется внутри арены и может сам из нее выделять
+		template <class T> T* FindOrConstruct(const char* name) {
+			if (!IsValid() || strlen(name) >= RootNameSize)
+				return NULL;
+			ArenaHeader* hdr = Header();
+			hdr->root_lock.Lock();
+			Root* root = FindRoot(name);
+			T* obj = NULL;
+			if (root != NULL) {
+				obj = At<T>(root->off);
+			} else {
+				for (int i = 0; i < MaxRoots && obj == NULL; i++) {
+					if (hdr->roots[i].off != 0)
+						continue;
+					// блоки выровнены на 16; объекту с alignas(64) (очереди и т.п.) добавляем запас
+					size_t extra = alignof(T) > 16 ? alignof(T) : 0;
+					char* mem = static_cast<char*>(Allocate(sizeof(T) + extra));
+					if (mem == NULL)
+						break;
+					if (extra != 0)
+						mem += (alignof(T) - OffsetOf(mem) % alignof(T)) % alignof(T);
+					obj = new (mem) T();
+					strcpy(hdr->roots[i].name, name);
+					hdr->roots[i].off = OffsetOf(mem);
+				}
+			}
+			hdr->root_lock.Unlock();
+			return obj;
+		}
+
+		// Блокировка для данных в арене (контейнеры сами себя не защищают).
+		// LOCK_OWNER_DIED - кто-то умер посреди изменения, контейнеры могут быть недостроены
+		LockResult Lock() { return Header()->user_lock.Lock(); }
+		void Unlock()     { Header()->user_lock.Unlock(); }
+
+		// Текущий размер файла сегмента, занято блоками и предел роста
+		size_t Size() const { return IsValid() ? Header()->size.load() : 0; }
+		size_t Used() const { return IsValid() ? Header()->used : 0; }
+		size_t MaxSize() const { return _max_size; }
+
+		bool Contains(const void* ptr) const {
+			const char* p = static_cast<const char*>(ptr);
+			return _base != NULL && p >= _base && p < _base + _max_size;
+		}
+
+		// Арена этого процесса, внутри которой лежит ptr. Так контейнеры находят,
+		// откуда выделять память, не храня у себя ничего процессо-зависимого
+		static SharedArena* Owner(const void* ptr) {
+			SharedArena* owner = NULL;
+			pthread_mutex_lock(&RegistryMutex());
+			std::vector<SharedArena*>& arenas = Registry();
+			for (size_t i = 0; i < arenas.size() && owner == NULL; i++) {
+				if (arenas[i]->Contains(ptr))
+					owner = arenas[i];
+			}
+			pthread_mutex_unlock(&RegistryMutex());
+			return owner;
+		}
+	private:
+		static const uint64_t ArenaMagic = 0x616e657261334c42ULL;
+		static const uint32_t BlockTag = 0xa110c8edu;
+		static const uint64_t InitialSize = 64 << 10;
+		enum {
+			MinBlockShift = 5,   // наименьший блок - 32 байта вместе с заголовком
+			Classes = 40
+		};
+
+		struct Root
+		{
+			char name[RootNameSize];
+			uint64_t off;
+		};
+		struct ArenaHeader
+		{
+			std::atomic<uint64_t> magic;
+			uint64_t max_size;
+			std::atomic<uint64_t> size;   // размер файла сегмента
+			uint64_t top;                 // граница размеченной части
+			uint64_t used;
+			uint64_t free_lists[Classes];
+			SharedMutex alloc_lock;
+			SharedMutex root_lock;
+			SharedMutex user_lock;
+			std::atomic<int32_t> cnt;
+			Root roots[MaxRoots];
+		};
+		struct Block
+		{
+			uint32_t cls;
+			uint32_t tag;
+			uint64_t next;   // смещение следующего свободного блока
+		};
+
+		ArenaHeader* Header() const { return reinterpret_cast<ArenaHeader*>(_base); }
+		template <class T> T* At(uint64_t off) const { return reinterpret_cast<T*>(_base + off); }
+		uint64_t OffsetOf(const void* ptr) const { return static_cast<const char*>(ptr) - _base; }
+
+		static uint64_t ClassBytes(int cls) { return uint64_t(1) << (cls + MinBlockShift); }
+		static int SizeClass(size_t bytes) {
+			for (int cls = 0; cls < Classes; cls++) {
+				if (ClassBytes(cls) >= bytes)
+					return cls;
+			}
+			return -1;
+		}
+		static size_t PageRound(uint64_t bytes) {
+			uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+			return static_cast<size_t>((bytes + page - 1) / page * page);
+		}
+		// заголовок занимает начало сегмента, блоки идут с выровненного смещения за ним
+		static uint64_t FirstBlock() { return (sizeof(ArenaHeader) + 63) / 64 * 64; }
+
+		bool Map(size_t max_size) {
+			void* res = mmap(NULL, max_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, _fd, 0);
+			if (res == MAP_FAILED)
+				return false;
+			_base = static_cast<char*>(res);
+			_max_size = max_size;
+			return true;
+		}
+		void UnMap() {
+			if (_base != NULL)
+				munmap(_base, _max_size);
+			_base = NULL;
+		}
+		bool Init(size_t max_size) {
+			size_t size = PageRound(FirstBlock() > InitialSize ? FirstBlock() : InitialSize);
+			max_size = PageRound(max_size);
+			if (max_size < size || ftruncate(_fd, size) != 0 || !Map(max_size))
+				return false;
+			ArenaHeader* hdr = new (_base) ArenaHeader();
+			hdr->max_size = max_size;
+			hdr->size.store(size);
+			hdr->top = FirstBlock();
+			hdr->used = 0;
+			memset(hdr->free_lists, 0, sizeof(hdr->free_lists));
+			hdr->cnt.store(0);
+			memset(hdr->roots, 0, sizeof(hdr->roots));
+			// magic последним: по нему открывающие узнают, что заголовок готов
+			hdr->magic.store(ArenaMagic, std::memory_order_release);
+			return true;
+		}
+		bool Attach() {
+			// создатель мог еще не успеть ни расширить файл, ни заполнить заголовок
+			for (int attempt = 0; attempt < 1000; attempt++) {
+				struct stat st;
+				if (fstat(_fd, &st) != 0)
+					return false;
+				if (static_cast<uint64_t>(st.st_size) >= FirstBlock()) {
+					if (_base == NULL && !Map(st.st_size))
+						return false;
+					if (Header()->magic.load(std::memory_order_acquire) == ArenaMagic) {
+						// предел роста задает создатель
+						size_t max_size = Header()->max_size;
+						UnMap();
+						return Map(max_size);
+					}
+				}
+				usleep(1000);
+			}
+			return false;
+		}
+		// вызывается под alloc_lock
+		bool Grow(uint64_t need) {
+			ArenaHeader* hdr = Header();
+			if (need > _max_size)
+				return false;
+			uint64_t size = hdr->size.load();
+			uint64_t new_size = PageRound(size * 2 > need ? size * 2 : need);
+			if (new_size > _max_size)
+				new_size = _max_size;
+			if (ftruncate(_fd, new_size) != 0)
+				return false;
+			hdr->size.store(new_size);
+			return true;
+		}
+		Root* FindRoot(const char* name) const {
+			for (int i = 0; i < MaxRoots; i++) {
+				Root& root = Header()->roots[i];
+				if (root.off != 0 && strncmp(root.name, name, RootNameSize) == 0)
+					return &root;
+			}
+			return NULL;
+		}
+
+
+		static std::vector<SharedArena*>& Registry() {
+			static std::vector<SharedArena*> arenas;
+			return arenas;
+		}
+		static pthread_mutex_t& RegistryMutex() {
+			static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+			return mutex;
+		}
+		static void Register(SharedArena* arena) {
+			pthread_mutex_lock(&RegistryMutex());
+			Registry().push_back(arena);
+			pthread_mutex_unlock(&RegistryMutex());
+		}
+		static void Unregister(SharedArena* arena) {
+			pthread_mutex_lock(&RegistryMutex());
+			std::vector<SharedArena*>& arenas = Registry();
+			for (size_t i = 0; i < arenas.size(); i++) {
+				if (arenas[i] == arena) {
+					arenas.erase(arenas.begin() + i);
+					break;
+				}
+			}
+			pthread_mutex_unlock(&RegistryMutex());
+		}
+
+		int _fd;
+		char* _base;
+		size_t _max_size;
+		std::string _fname;
+
+		// Защита от копирования
+		SharedArena(SharedArena const&) {}
+		SharedArena& operator=(SharedArena const&) { return *this; }
+	};
+
+	// Контейнеры ниже должны лежать внутри арены (FindOrConstruct, элементы других
+	// контейнеров). Память под содержимое они берут у арены, в которой лежат сами.
+	// Если места нет, операции возвращают false/NULL, содержимое при этом не портится
+
+	template <class T> class ShmVector
+	{
+	public:
+		ShmVector() :_size(0), _cap(0) {}
+		ShmVector(ShmVector&& other) :_data(other._data), _size(other._size), _cap(other._cap) {
+			other._data = NULL;
+			other._size = 0;
+			other._cap = 0;
+		}
+		~ShmVector() {
+			Clear();
+			SharedArena* arena = SharedArena::Owner(this);
+			if (arena != NULL)
+				arena->Deallocate(_data.Get());
+		}
+
+		size_t Size() const { return static_cast<size_t>(_size); }
+		size_t Capacity() const { return static_cast<size_t>(_cap); }
+		bool Empty() const { return _size == 0; }
+		T* Data() const { return _data.Get(); }
+		T& operator[](size_t i) const { return _data.Get()[i]; }
+		T* begin() const { return _data.Get(); }
+		T* end() const { return _data.Get() + _size; }
+
+		bool Reserve(size_t cap) {
+			if (cap <= _cap)
+				return true;
+			SharedArena* arena = SharedArena::Owner(this);
+			T* fresh = (arena != NULL) ? static_cast<T*>(arena->Allocate(cap * sizeof(T))) : NULL;
+			if (fresh == NULL)
+				return false;
+			// перемещаем поэлементно, а не memcpy: у элементов могут быть свои OffsetPtr
+			T* old = _data.Get();
+			for (uint64_t i = 0; i < _size; i++) {
+				new (fresh + i) T(std::move(old[i]));
+				old[i].~T();
+			}
+			arena->Deallocate(old);
+			_data = fresh;
+			_cap = cap;
+			return true;
+		}
+		template <class... Args> bool EmplaceBack(Args&&... args) {
+			if (_size == _cap && !Reserve(_cap == 0 ? 8 : _cap * 2))
+				return false;
+			new (_data.Get() + _size) T(std::forward<Args>(args)...);
+			_size++;
+			return true;
+		}
+		bool PushBack(const T& value) { return EmplaceBack(value); }
+		void PopBack() {
+			if (_size > 0)
+				_data.Get()[--_size].~T();
+		}
+		void Clear() {
+			while (_size > 0)
+				PopBack();
+		}
+	private:
+		OffsetPtr<T> _data;
+		uint64_t _size;
+		uint64_t _cap;
+
+		ShmVector(ShmVector const&) {}
+		ShmVector& operator=(ShmVector const&) { return *this; }
+	};
+
+	class ShmString
+	{
+	public:
+		ShmString() :_size(0), _cap(0) {}
+		ShmString(const char* str) :_size(0), _cap(0) { Assign(str, strlen(str)); }
+		ShmString(const std::string& str) :_size(0), _cap(0) { Assign(str.data(), str.size()); }
+		ShmString(ShmString&& other) :_data(other._data), _size(other._size), _cap(other._cap) {
+			other._data = NULL;
+			other._size = 0;
+			other._cap = 0;
+		}
+		~ShmString() {
+			SharedArena* arena = SharedArena::Owner(this);
+			if (arena != NULL)
+				arena->Deallocate(_data.Get());
+		}
+
+		bool Assign(const char* str, size_t size) {
+			_size = 0;
+			return Append(str, size);
+		}
+		bool Assign(const std::string& str) { return Assign(str.data(), str.size()); }
+		bool Append(const char* str, size_t size) {
+			if (!Reserve(_size + size))
+				return false;
+			memmove(_data.Get() + _size, str, size);
+			_size += size;
+			_data.Get()[_size] = '\0';
+			return true;
+		}
+
+		size_t Size() const { return static_cast<size_t>(_size); }
+		bool Empty() const { return _size == 0; }
+		const char* CStr() const { return _data ? _data.Get() : ""; }
+		std::string Str() const { return std::string(CStr(), Size()); }
+
+		bool operator==(const ShmString& other) const { return Equals(other.CStr(), other.Size()); }
+		bool operator==(const std::string& other) const { return Equals(other.data(), other.size()); }
+		bool operator==(const char* other) const { return Equals(other, strlen(other)); }
+	private:
+		OffsetPtr<char> _data;
+		uint64_t _size;
+		uint64_t _cap;
+
+		bool Equals(const char* str, size_t size) const {
+			return size == _size && memcmp(CStr(), str, size) == 0;
+		}
+		bool Reserve(size_t size) {
+			if (size < _cap)
+				return true;
+			SharedArena* arena = SharedArena::Owner(this);
+			size_t cap = (_cap * 2 > size + 1) ? _cap * 2 : size + 1;
+			char* fresh = (arena != NULL) ? static_cast<char*>(arena->Allocate(cap)) : NULL;
+			if (fresh == NULL)
+				return false;
+			memcpy(fresh, CStr(), _size + 1);
+			arena->Deallocate(_data.Get());
+			_data = fresh;
+			_cap = cap;
+			return true;
+		}
+
+		ShmString(ShmString const&) {}
+		ShmString& operator=(ShmString const&) { return *this; }
+	};
+
+	// Хеш и сравнение, понимающие и ShmString, и обычные строки: искать в таблице
+	// со строковыми ключами можно, не создавая ключ в разделяемой памяти
+	struct ShmHash
+	{
+		static uint64_t Bytes(const char* data, size_t size) {
+			uint64_t hash = 14695981039346656037ULL;   // FNV-1a
+			for (size_t i = 0; i < size; i++) {
+				hash ^= static_cast<unsigned char>(data[i]);
+				hash *= 1099511628211ULL;
+			}
+			return hash;
+		}
+		uint64_t operator()(const ShmString& str) const { return Bytes(str.CStr(), str.Size()); }
+		uint64_t operator()(const std::string& str) const { return Bytes(str.data(), str.size()); }
+		uint64_t operator()(const char* str) const { return Bytes(str, strlen(str)); }
+		template <class T> uint64_t operator()(const T& value) const { return std::hash<T>()(value); }
+	};
+	struct ShmEqual
+	{
+		template <class A, class B> bool operator()(const A& a, const B& b) const { return a == b; }
+	};
+
+	// Хеш-таблица с цепочками. Узлы не переезжают, при росте перестраивается только массив корзин
+	template <class K, class V, class Hash = ShmHash, class Equal = ShmEqual> class ShmHashMap
+	{
+		struct Node
+		{
+			template <class Q> Node(const Q& k, uint64_t h) :hash(h), key(k), value() {}
+			OffsetPtr<Node> next;
+			uint64_t hash;
+			K key;
+			V value;
+		};
+	public:
+		ShmHashMap() :_bucket_count(0), _size(0) {}
+		~ShmHashMap() {
+			Clear();
+			SharedArena* arena = SharedArena::Owner(this);
+			if (arena != NULL)
+				arena->Deallocate(_buckets.Get());
+		}
+
+		size_t Size() const { return static_cast<size_t>(_size); }
+		bool Empty() const { return _size == 0; }
+
+		template <class Q> V* Find(const Q& key) const {
+			if (_bucket_count == 0)
+				return NULL;
+			uint64_t hash = Hash()(key);
+			for (Node* node = Bucket(hash).Get(); node != NULL; node = node->next.Get()) {
+				if (node->hash == hash && Equal()(node->key, key))
+					return &node->value;
+			}
+			return NULL;
+		}
+		// Значение по ключу; если ключа нет - добавляется со значением по умолчанию.
+		// NULL - в арене не нашлось места
+		template <class Q> V* Insert(const Q& key, bool* inserted = NULL) {
+			if (inserted != NULL)
+				*inserted = false;
+			V* found = Find(key);
+			if (found != NULL)
+				return found;
+			if (_size >= _bucket_count && !Rehash(_bucket_count == 0 ? 16 : _bucket_count * 2) && _bucket_count == 0)
+				return NULL;
+			SharedArena* arena = SharedArena::Owner(this);
+			void* mem = (arena != NULL) ? arena->Allocate(sizeof(Node)) : NULL;
+			if (mem == NULL)
+				return NULL;
+			uint64_t hash = Hash()(key);
+			Node* node = new (mem) Node(key, hash);
+			OffsetPtr<Node>& head = Bucket(hash);
+			node->next = head;
+			head = node;
+			_size++;
+			if (inserted != NULL)
+				*inserted = true;
+			return &node->value;
+		}
+		template <class Q> bool Erase(const Q& key) {
+			if (_bucket_count == 0)
+				return false;
+			uint64_t hash = Hash()(key);
+			OffsetPtr<Node>* link = &Bucket(hash);
+			while (Node* node = link->Get()) {
+				if (node->hash == hash && Equal()(node->key, key)) {
+					*link = node->next;
+					Destroy(node);
+					_size--;
+					return true;
+				}
+				link = &node->next;
+			}
+			return false;
+		}
+		void Clear() {
+			for (uint64_t i = 0; i < _bucket_count; i++) {
+				Node* node = _buckets.Get()[i].Get();
+				while (node != NULL) {
+					Node* next = node->next.Get();
+					Destroy(node);
+					node = next;
+				}
+				_buckets.Get()[i] = NULL;
+			}
+			_size = 0;
+		}
+		// fn(const K&, V&) для каждой пары, порядок не определен
+		template <class F> void ForEach(F fn) const {
+			for (uint64_t i = 0; i < _bucket_count; i++) {
+				for (Node* node = _buckets.Get()[i].Get(); node != NULL; node = node->next.Get())
+					fn(static_cast<const K&>(node->key), node->value);
+			}
+		}
+	private:
+		OffsetPtr<OffsetPtr<Node> > _buckets;
+		uint64_t _bucket_count;   // всегда степень двойки
+		uint64_t _size;
+
+		OffsetPtr<Node>& Bucket(uint64_t hash) const { return _buckets.Get()[hash & (_bucket_count - 1)]; }
+		void Destroy(Node* node) {
+			node->~Node();
+			SharedArena* arena = SharedArena::Owner(this);
+			if (arena != NULL)
+				arena->Deallocate(node);
+		}
+		bool Rehash(uint64_t count) {
+			SharedArena* arena = SharedArena::Owner(this);
+			OffsetPtr<Node>* fresh = (arena != NULL) ?
+				static_cast<OffsetPtr<Node>*>(arena->Allocate(count * sizeof(OffsetPtr<Node>))) : NULL;
+			if (fresh == NULL)
+				return false;
+			for (uint64_t i = 0; i < count; i++)
+				new (fresh + i) OffsetPtr<Node>();
+			for (uint64_t i = 0; i < _bucket_count; i++) {
+				Node* node = _buckets.Get()[i].Get();
+				while (node != NULL) {
+					Node* next = node->next.Get();
+					OffsetPtr<Node>& head = fresh[node->hash & (count - 1)];
+					node->next = head;
+					head = node;
+					node = next;
+				}
+			}
+			arena->Deallocate(_buckets.Get());
+			_buckets = fresh;
+			_bucket_count = count;
+			return true;
+		}
+
+		ShmHashMap(ShmHashMap const&) {}
+		ShmHashMap& operator=(ShmHashMap const&) { return *this; }
+	};
+}
+
+#endif // WIN32
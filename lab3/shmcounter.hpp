@@ -0,0 +1,65 @@
+#pragma once
+
+// Счетчик, разложенный по строкам кэша. Один общий счетчик, который увеличивают все
+// процессы, заставляет его строку кэша прыгать между ядрами на каждом увеличении.
+// Здесь у каждого ядра своя ячейка в своей строке: Add() трогает только ее,
+// а Sum() складывает все ячейки, когда итог действительно нужен.
+//
+// Ячейки - обычные целые с атомарными операциями, без std::atomic: счетчик остается
+// тривиально копируемым и может лежать в T для SharedMem (в том числе под Read()).
+
+#if !defined (WIN32)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>      /* sched_getcpu() */
+#include <unistd.h>
+
+#ifndef CPLIB_CACHE_LINE
+#	define CPLIB_CACHE_LINE 64
+#endif
+
+namespace cplib
+{
+	template <size_t Slots = 64> class StripedCounter
+	{
+		static_assert(Slots >= 1, "StripedCounter needs at least one slot");
+	public:
+		// Ячейку выбирает ядро, на котором мы сейчас работаем: процессы на разных ядрах
+		// пишут в разные строки. Переезд процесса на другое ядро ничего не ломает,
+		// увеличение атомарное в любой ячейке
+		void Add(int64_t delta = 1) {
+			__atomic_fetch_add(&_slots[Slot()].value, delta, __ATOMIC_RELAXED);
+		}
+		// Сумма по всем ячейкам. Пока идут Add(), это значение на какой-то момент во время обхода
+		int64_t Sum() const {
+			int64_t sum = 0;
+			for (size_t i = 0; i < Slots; i++)
+				sum += __atomic_load_n(&_slots[i].value, __ATOMIC_RELAXED);
+			return sum;
+		}
+		// Обнулить и вернуть сколько было. Add() во время обхода не теряются:
+		// каждая ячейка забирается атомарным обменом
+		int64_t Drain() {
+			int64_t sum = 0;
+			for (size_t i = 0; i < Slots; i++)
+				sum += __atomic_exchange_n(&_slots[i].value, 0, __ATOMIC_RELAXED);
+			return sum;
+		}
+	private:
+		static size_t Slot() {
+			int cpu = sched_getcpu();
+			if (cpu < 0)
+				cpu = getpid();   // нет sched_getcpu - хотя бы разные процессы в разные ячейки
+			return static_cast<size_t>(cpu) % Slots;
+		}
+
+		struct alignas(CPLIB_CACHE_LINE) Cell
+		{
+			int64_t value;
+		};
+		Cell _slots[Slots];
+	};
+}
+
+#endif // WIN32
@@ -2,6 +2,10 @@
 
 #include <string.h>   // strlen()
 #include <stdlib.h>   // malloc()
+#include <new>        // placement new
+#include <atomic>     // версия для чтения без блокировки
+#include <type_traits>
+#include "shmmutex.hpp"
 #if defined (WIN32)
 #   include <windows.h>
 #	define MAP_NAME_PREFIX "Local\\"
@@ -12,11 +16,16 @@
 #   include <sys/stat.h>        /* Константы режимов */
 #   include <fcntl.h>           /* Константы O_* */
 #   include <unistd.h>          /* ftruncate() */
-#   include <semaphore.h>       /* семафоры */
+#   include <sched.h>           /* sched_yield() */
+#   include <time.h>            /* nanosleep() */
+#   include <limits.h>          /* INT_MAX */
+#   include "futex.hpp"         /* ожидание изменений */
+#   include <sys/syscall.h>     /* mbind() без libnuma */
+#   include <linux/mempolicy.h> /* MPOL_BIND */
 #   define HANDLE          int
 #   define INV_HANDLE      (-1)
 #	define MAP_NAME_PREFIX  "/"
-#	define CSEM            sem_t*
+#	define CSEM            cplib::SharedMutex*   /* блокировка живет в самом сегменте */
 
 #endif
 
@@ -24,10 +33,23 @@
 
 namespace cplib
 {
+	// Как отображать сегмент (флаги можно складывать). Каждый процесс задает их для своего
+	// отображения сам; что из запрошенного получилось - AppliedOptions()
+	enum SharedMemOptions
+	{
+		SHMEM_DEFAULT = 0,
+		SHMEM_PREFAULT = 1,    // Заполнить таблицы страниц сразу, а не страничными ошибками при первых обращениях
+		SHMEM_HUGE_PAGES = 2,  // Большие страницы (для shm - прозрачные, MADV_HUGEPAGE): меньше промахов TLB для больших T
+		SHMEM_LOCK = 4,        // mlock: не выгружать в своп (упирается в RLIMIT_MEMLOCK)
+		SHMEM_NUMA = 8         // Только в AppliedOptions(): страницы привязаны к узлу numa_node
+	};
+
     template <class T> class SharedMem
     {
     public:
-        SharedMem(const char* name, bool create_if_not_exists = true):_fd(INV_HANDLE),_mem(NULL), _sem(NULL){
+        // numa_node >= 0 - выделять страницы сегмента на этом узле NUMA
+        SharedMem(const char* name, bool create_if_not_exists = true, int options = SHMEM_DEFAULT, int numa_node = -1)
+            :_fd(INV_HANDLE),_mem(NULL), _sem(NULL), _options(options), _numa_node(numa_node), _applied(SHMEM_DEFAULT){
 			// Получим системное имя для объекта памяти
 			_fname = (char*)malloc(strlen(name) + strlen(MAP_NAME_PREFIX) + 1);
 			memcpy(_fname, MAP_NAME_PREFIX, strlen(MAP_NAME_PREFIX));
@@ -44,18 +66,30 @@ namespace cplib
 					is_new = true;
 			}
 			// Попытаемся подключить область памяти
+			if (ret)
+				ret = is_new || WaitCreated();
 			if (ret)
 				ret = MapMem();
 			// Если подключили новую память - ее необходимо инициализировать
 			if (ret && is_new) {
+#if !defined (WIN32)
+				new (&_mem->lock) SharedMutex();
+#endif
 				_mem->cnt = 0;
-				_mem->str = T();
+				_mem->seq.store(0);
+				_mem->events.store(0);
+				_mem->waiters.store(0);
+				// конструируем на месте: T может быть некопируемым (атомарные поля и т.п.)
+				new (&_mem->str) T();
+				_mem->ready.store(1, std::memory_order_release);
 			}
+			if (ret && !is_new)
+				ret = WaitReady();
 			if (ret) {
 				// Зарегистрируемся
-				LockSema();
+				LockShared();
 				_mem->cnt++;
-				UnlockSema();
+				UnlockShared();
 			} else {
 				// На каком-то этапе провалились - удалим (или освободим) память
 				if (is_new)
@@ -67,10 +101,10 @@ namespace cplib
 		virtual ~SharedMem() {
 			if (IsValid()) {
 				int cnt = 0;
-				LockSema();
+				LockShared();
 				_mem->cnt--;
 				cnt = _mem->cnt;
-				UnlockSema();
+				UnlockShared();
 				if (cnt <= 0)
 					DestroyMem();
 				else
@@ -81,45 +115,231 @@ namespace cplib
 			free(_semname);
 		}
         bool IsValid() {return _fd != INV_HANDLE && _sem != NULL && _mem != NULL;}
-		void Lock()    {LockSema();}
+		// Какие из запрошенных SharedMemOptions удалось применить к нашему отображению
+		int AppliedOptions() const {return _applied;}
+		// Писатели меняют данные под Lock()/Unlock(). Нечетная версия - идет запись.
+		// LOCK_OWNER_DIED - прошлый владелец умер, не отпустив блокировку: T мог остаться
+		// недописанным, его стоит проверить (блокировка при этом наша)
+		LockResult Lock() {
+			LockResult res = LockShared();
+			// версию меняем только под блокировкой, так что хватает обычной записи без RMW.
+			// Писатель умер посреди записи - версия осталась нечетной, запись продолжаем мы
+			uint32_t seq = _mem->seq.load(std::memory_order_relaxed);
+			if (res != LOCK_OWNER_DIED || (seq & 1) == 0)
+				_mem->seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			return res;
+		}
 		T* Data() {
 			if (!IsValid())
 				return NULL;
 			return &_mem->str;
 		}
-		void Unlock() {UnlockSema();}
+		void Unlock() {
+			// seq_cst: ждущий в WaitUntil() либо увидит новую версию, либо будет нами разбужен
+			_mem->seq.store(_mem->seq.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+			UnlockShared();
+			WakeWaiters();
+		}
+		// Согласованная копия данных без захвата семафора (seqlock): читатель ничего
+		// не пишет в общую память и копирует заново, только если попал на запись
+		void Read(T& out) const {
+			static_assert(std::is_trivially_copyable<T>::value, "Read() copies T as raw bytes");
+			for (unsigned spins = 0; ; spins++) {
+				uint32_t before = _mem->seq.load(std::memory_order_acquire);
+				if ((before & 1) == 0) {
+					memcpy(&out, &_mem->str, sizeof(T));
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (_mem->seq.load(std::memory_order_relaxed) == before)
+						return;
+				}
+				// писатель на нашем же ядре не закончит, пока мы крутимся
+				if (spins > 64)
+					YieldCpu();
+				// версия давно нечетная - писатель мог умереть посреди записи
+				if ((before & 1) != 0 && spins % 1024 == 1023)
+					RepairAbandoned();
+			}
+		}
+		T Snapshot() const {
+			T out;
+			Read(out);
+			return out;
+		}
+		// Сколько раз данные меняли под Lock()
+		uint32_t Version() const {
+			return _mem->seq.load(std::memory_order_acquire) / 2;
+		}
+
+		// Атомарные операции над одним полем T, без блокировки (системный вызов - только
+		// чтобы разбудить тех, кто ждет в WaitUntil()):
+		//   shm.FetchAdd(&Data::counter, 1);
+		//   shm.Update(&Data::counter, [](int v) { return v * 2; });
+		// Поле - выровненное целое или указатель. Версию (Read/Version) они не меняют:
+		// Snapshot() видит каждое поле целиком, но не связь между полями
+		template <class F> F Load(F T::*field) const {
+			F* ptr = &(_mem->str.*field);
+#if defined (__GNUC__)
+			return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+			return *reinterpret_cast<volatile F*>(ptr);
+#endif
+		}
+		template <class F> void Store(F T::*field, F value) {
+			F* ptr = &(_mem->str.*field);
+#if defined (__GNUC__)
+			__atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+			WakeWaiters();
+#else
+			Lock();
+			*ptr = value;
+			Unlock();
+#endif
+		}
+		// Вернуть старое значение
+		template <class F> F FetchAdd(F T::*field, F delta) {
+			F* ptr = &(_mem->str.*field);
+#if defined (__GNUC__)
+			F old = __atomic_fetch_add(ptr, delta, __ATOMIC_SEQ_CST);
+			WakeWaiters();
+			return old;
+#else
+			Lock();
+			F old = *ptr;
+			*ptr = old + delta;
+			Unlock();
+			return old;
+#endif
+		}
+		// Если поле равно expected - записать desired. Иначе в expected - текущее значение
+		template <class F> bool CompareExchange(F T::*field, F& expected, F desired) {
+			F* ptr = &(_mem->str.*field);
+#if defined (__GNUC__)
+			if (!__atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+				return false;
+			WakeWaiters();
+			return true;
+#else
+			Lock();
+			bool ok = (*ptr == expected);
+			if (ok)
+				*ptr = desired;
+			else
+				expected = *ptr;
+			Unlock();
+			return ok;
+#endif
+		}
+		// Произвольное изменение поля: fn(старое) -> новое, повторяется, пока поле меняют другие.
+		// fn может вызываться несколько раз и не должна иметь побочных эффектов. Вернуть новое
+		template <class F, class Fn> F Update(F T::*field, Fn fn) {
+			F expected = Load(field);
+			F desired = fn(expected);
+			while (!CompareExchange(field, expected, desired))
+				desired = fn(expected);
+			return desired;
+		}
+
+		// Ожидание изменений вместо опроса по таймеру. Будят Unlock() и атомарные операции
+		// выше; пока никто не ждет, они платят только чтением счетчика ждущих.
+		// Ждать, пока ready() не вернет true. false - вышел timeout (< 0 - ждать вечно).
+		// ready() проверяется после каждого изменения данных любым процессом
+		template <class Ready> bool WaitUntil(Ready ready, double timeout = -1.0) {
+			double deadline = timeout >= 0.0 ? Now() + timeout : -1.0;
+			while (!ready()) {
+				double left = -1.0;
+				if (deadline >= 0.0) {
+					left = deadline - Now();
+					if (left <= 0.0)
+						return false;
+				}
+#if defined (WIN32)
+				// межпроцессного futex нет - опрашиваем
+				(void)left;
+				Pause();
+#else
+				_mem->waiters.fetch_add(1);
+				uint32_t events = _mem->events.load();
+				// проверка после регистрации: писатель либо увидит нас, либо мы - его изменения
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!ready())
+					FutexWait(&_mem->events, events, left);
+				_mem->waiters.fetch_sub(1);
+#endif
+			}
+			return true;
+		}
+		// Пока Version() не станет больше version
+		bool WaitVersion(uint32_t version, double timeout = -1.0) {
+			return WaitUntil([this, version] { return Version() > version; }, timeout);
+		}
+		// Пока поле не перестанет быть равным old
+		template <class F> bool WaitChange(F T::*field, F old, double timeout = -1.0) {
+			return WaitUntil([this, field, old] { return Load(field) != old; }, timeout);
+		}
+		// Разбудить ждущих, чтобы они перепроверили условие: после изменений, о которых
+		// SharedMem не знает (данные процесса, флаг остановки и т.п.)
+		void Notify() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			WakeWaiters();
+		}
 	private:
         bool OpenMem(const char* mem_name, const char* sem_name) {
 #if defined (WIN32)
 			_fd = OpenFileMapping(FILE_MAP_WRITE, true, mem_name);
 			if (_fd != INV_HANDLE)
-				_sem = OpenSemaphore(SEMAPHORE_ALL_ACCESS, false, sem_name);
+				_sem = OpenMutex(SYNCHRONIZE, false, sem_name);
+            return (_fd != INV_HANDLE && _sem != NULL);
 #else
+            // мьютекс лежит в сегменте, его адрес узнаем в MapMem()
+            (void)sem_name;
             _fd = shm_open(mem_name, O_RDWR, 0644);
-			if (_fd != INV_HANDLE) {
-				_sem = sem_open(sem_name, 0);
-                if (_sem == SEM_FAILED)
-                    _sem = NULL;
-            }
+            return (_fd != INV_HANDLE);
 #endif
-            return (_fd != INV_HANDLE && _sem != NULL);
         }
 		bool CreateMem(const char* mem_name, const char* sem_name) {
 #if defined (WIN32)
 			_fd = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(shmem_contents), mem_name);
+			// именованный мьютекс: как и robust-мьютекс, сообщает о смерти владельца (WAIT_ABANDONED)
 			if (_fd != INV_HANDLE)
-				_sem = CreateSemaphore(NULL, 0, 1, sem_name);
+				_sem = CreateMutex(NULL, false, sem_name);
+            return (_fd != INV_HANDLE && _sem != NULL);
 #else
+			(void)sem_name;
 			_fd = shm_open(mem_name, O_CREAT | O_EXCL | O_RDWR, 0644);
-			if (_fd != INV_HANDLE) {
-				ftruncate(_fd, sizeof(shmem_contents));
-				_sem = sem_open(sem_name, O_CREAT | O_EXCL, 0644, 1);
-                if (_sem == SEM_FAILED)
-                    _sem = NULL;
+			if (_fd != INV_HANDLE && ftruncate(_fd, sizeof(shmem_contents)) != 0) {
+				close(_fd);
+				shm_unlink(mem_name);
+				_fd = INV_HANDLE;
 			}
+            return (_fd != INV_HANDLE);
 #endif
-            return (_fd != INV_HANDLE && _sem != NULL);
         }
+		// Создатель мог еще не успеть расширить файл: до этого обращение к памяти - SIGBUS
+		bool WaitCreated() {
+#if !defined (WIN32)
+			for (int attempt = 0; attempt < 1000; attempt++) {
+				struct stat st;
+				if (fstat(_fd, &st) != 0)
+					return false;
+				if (st.st_size >= (off_t)sizeof(shmem_contents))
+					return true;
+				Pause();
+			}
+			return false;
+#else
+			return true;
+#endif
+		}
+		// ... и заполнить заголовок
+		bool WaitReady() {
+			for (int attempt = 0; attempt < 1000; attempt++) {
+				if (_mem->ready.load(std::memory_order_acquire) != 0)
+					return true;
+				Pause();
+			}
+			return false;
+		}
 		bool MapMem() {
 			if (_fd == INV_HANDLE)
 				return NULL;
@@ -129,11 +349,50 @@ namespace cplib
 			void* res = mmap(NULL, sizeof(struct shmem_contents), PROT_WRITE | PROT_READ, MAP_SHARED, _fd, 0);
 			if (res == MAP_FAILED)
 				_mem = NULL;
-            else
+            else {
                 _mem = reinterpret_cast<shmem_contents*>(res);
+                _sem = &_mem->lock;
+            }
 #endif
+			if (_mem != NULL)
+				ApplyOptions();
 			return (_mem != NULL);
 		}
+		// Порядок важен: политика NUMA и большие страницы действуют только на страницы,
+		// выделенные после них, поэтому заполняем и закрепляем в самом конце
+		void ApplyOptions() {
+#if !defined (WIN32)
+			size_t size = sizeof(struct shmem_contents);
+			if (_numa_node >= 0 && _numa_node < (int)(sizeof(unsigned long) * 8)) {
+				unsigned long nodemask = 1UL << _numa_node;
+				if (syscall(SYS_mbind, _mem, size, MPOL_BIND, &nodemask, sizeof(nodemask) * 8 + 1, MPOL_MF_MOVE) == 0)
+					_applied |= SHMEM_NUMA;
+			}
+			// MAP_HUGETLB для файлов shm_open (tmpfs) не работает - EINVAL. Прозрачные большие
+			// страницы tmpfs выдает, если разрешены в /sys/kernel/mm/transparent_hugepage/shmem_enabled
+			if ((_options & SHMEM_HUGE_PAGES) && madvise(_mem, size, MADV_HUGEPAGE) == 0)
+				_applied |= SHMEM_HUGE_PAGES;
+			if ((_options & SHMEM_PREFAULT) && Prefault(size))
+				_applied |= SHMEM_PREFAULT;
+			if ((_options & SHMEM_LOCK) && mlock(_mem, size) == 0)
+				_applied |= SHMEM_LOCK;
+#endif
+		}
+#if !defined (WIN32)
+		bool Prefault(size_t size) {
+#	if defined (MADV_POPULATE_WRITE)
+			if (madvise(_mem, size, MADV_POPULATE_WRITE) == 0)
+				return true;
+#	endif
+			// старое ядро: трогаем по байту на страницу. Атомарно и без изменения значения,
+			// другие процессы в это время могут писать в те же байты
+			long page = sysconf(_SC_PAGESIZE);
+			char* base = reinterpret_cast<char*>(_mem);
+			for (size_t offset = 0; offset < size; offset += page)
+				__atomic_fetch_or(base + offset, 0, __ATOMIC_RELAXED);
+			return true;
+		}
+#endif
 		bool UnMapMem() {
 			if (_mem == NULL)
 				return false;
@@ -156,47 +415,114 @@ namespace cplib
 #endif		
 				_fd = INV_HANDLE;
 			}
-			if (_sem != NULL) {
 #if defined (WIN32)
+			if (_sem != NULL)
 				CloseHandle(_sem);
-#else
-				sem_close(_sem);
 #endif
-				_sem = NULL;
-			}
+			_sem = NULL;
 		}
 		void DestroyMem()
 		{
 			CloseMem();
-			// В Windows и семафоры и память удалятся автоматически, когда никто не будет их использовать
+			// В Windows и мьютекс и память удалятся автоматически, когда никто не будет их использовать
 #if !defined (WIN32)
 			shm_unlink(_fname);
-			sem_unlink(_semname);
 #endif
 		}
-		void LockSema()
+		// Блокировка свободна или досталась от мертвого - значит, никто не пишет, а версия
+		// нечетная с прошлой записи. Завершаем ее, как Lock()/Unlock(): T при этом
+		// мог остаться недописанным, читатель получит то, что успели записать
+		void RepairAbandoned() const
+		{
+			LockResult res = TryLockShared();
+			if (res == LOCK_FAILED)
+				return;   // занята живым писателем - он и закончит
+			uint32_t seq = _mem->seq.load(std::memory_order_relaxed);
+			if ((seq & 1) != 0)
+				_mem->seq.store(seq + 1, std::memory_order_seq_cst);
+			UnlockShared();
+			if ((seq & 1) != 0)
+				WakeWaiters();
+		}
+		LockResult TryLockShared() const
 		{
 #if defined (WIN32)
-			ReleaseSemaphore(_sem, 1, NULL);
+			DWORD ret = WaitForSingleObject(_sem, 0);
+			if (ret == WAIT_ABANDONED)
+				return LOCK_OWNER_DIED;
+			return ret == WAIT_OBJECT_0 ? LOCK_OK : LOCK_FAILED;
 #else
-			sem_post(_sem);
+			return _sem->TryLock();
 #endif
 		}
-		void UnlockSema()
+		LockResult LockShared()
 		{
 #if defined (WIN32)
-			WaitForSingleObject(_sem, 0);
+			DWORD ret = WaitForSingleObject(_sem, INFINITE);
+			if (ret == WAIT_ABANDONED)
+				return LOCK_OWNER_DIED;
+			return ret == WAIT_OBJECT_0 ? LOCK_OK : LOCK_FAILED;
 #else
-			sem_wait(_sem);
+			return _sem->Lock();
+#endif
+		}
+		void UnlockShared() const
+		{
+#if defined (WIN32)
+			ReleaseMutex(_sem);
+#else
+			_sem->Unlock();
+#endif
+		}
+		void WakeWaiters() const {
+#if !defined (WIN32)
+			if (_mem->waiters.load(std::memory_order_seq_cst) != 0) {
+				_mem->events.fetch_add(1);
+				FutexWake(&_mem->events, INT_MAX);
+			}
+#endif
+		}
+		static double Now() {
+#if defined (WIN32)
+			return GetTickCount64() / 1000.0;
+#else
+			struct timespec t;
+			clock_gettime(CLOCK_MONOTONIC, &t);
+			return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+		}
+		static void YieldCpu() {
+#if defined (WIN32)
+			SwitchToThread();
+#else
+			sched_yield();
+#endif
+		}
+		static void Pause() {
+#if defined (WIN32)
+			::Sleep(1);
+#else
+			struct timespec t = {0, 1000000};
+			nanosleep(&t, NULL);
 #endif
 		}
         struct shmem_contents
         {
             T      str;
             int    cnt;
+            std::atomic<uint32_t> seq;   // четная - данные не меняются
+            std::atomic<uint32_t> ready; // создатель закончил инициализацию
+            std::atomic<uint32_t> events;  // futex для WaitUntil(): растет, когда будят ждущих
+            std::atomic<uint32_t> waiters; // сколько сейчас ждут
+#if !defined (WIN32)
+            SharedMutex lock;
+#endif
         } *_mem;
         CSEM   _sem;
         HANDLE _fd;
+        int _options;
+        int _numa_node;
+        int _applied;
         char* _fname;
         char* _semname;
 	};
@@ -0,0 +1,326 @@
+#pragma once
+
+// Хеш-таблица фиксированной емкости для общего сегмента: кладется целиком в SharedMem
+// (SharedMem<ShmHashTable<long long, 4096>>) и не зависит от адреса отображения.
+// Открытая адресация с линейным пробированием, ключи - строки прямо в ячейках.
+// Поиск без блокировок: у каждой ячейки свой seqlock. Вставка и изменение блокируют
+// только свою ячейку: CAS поля owner из 0 в свой pid, затем номер ячейки в нечетный.
+// Писатель умер, не отпустив ячейку (внутри fn у Update или посреди занятия ключа) -
+// кто-то из ждущих замечает это по pid и забирает ячейку себе, как робастный мьютекс
+// у SharedMem: недозанятая ячейка снова свободна, недописанное значение остается как есть.
+// Живость проверяется через kill(pid, 0), поэтому все процессы должны видеть одни pid
+// (одно пространство имен pid); переиспользованный pid задержит ячейку, пока он жив.
+// Ключ, однажды занявший ячейку, из нее не уходит: Erase() оставляет ее за тем же ключом,
+// повторная вставка оживляет ту же ячейку. Поэтому один ключ не попадет в две ячейки
+// при гонке вставок, а читателю не нужно перепроверять ключ. Плата - удаленные ключи
+// продолжают занимать емкость до Clear().
+
+#if !defined (WIN32)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sched.h>
+#include <signal.h>     /* kill(pid, 0) - жив ли писатель ячейки */
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include <type_traits>
+
+namespace cplib
+{
+	// Статистика заполнения (обход всей таблицы, не для горячего пути)
+	struct ShmHashStats
+	{
+		size_t capacity;
+		size_t size;          // живые ключи
+		size_t erased;        // ячейки удаленных ключей
+		double load_factor;   // занятые ячейки (живые и удаленные) / capacity
+		double mean_probe;    // среднее число ячеек, просмотренных до живого ключа
+		size_t max_probe;
+	};
+
+	template <class V, size_t Capacity, size_t KeyLen = 32> class ShmHashTable
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+		static_assert(std::is_trivially_copyable<V>::value, "V is copied between processes as raw bytes");
+	public:
+		// Максимальная длина ключа без завершающего нуля
+		static const size_t MaxKey = KeyLen - 1;
+
+		ShmHashTable() {
+			for (size_t i = 0; i < Capacity; i++) {
+				_slots[i].seq.store(0, std::memory_order_relaxed);
+				_slots[i].owner.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		// Без блокировок. false - ключа нет
+		bool Find(const char* key, V& out) const {
+			size_t len = strlen(key);
+			if (len > MaxKey)
+				return false;
+			const Slot* slot = Lookup(key, len, Hash(key, len));
+			return slot != NULL && ReadValue(*slot, out);
+		}
+		bool Contains(const char* key) const {
+			V value;
+			return Find(key, value);
+		}
+		// Вставить или заменить. false - ключ длиннее MaxKey или таблица полна
+		bool Insert(const char* key, const V& value) {
+			return Update(key, [&value](V& v) { v = value; });
+		}
+		// fn(V&) меняет значение под блокировкой ячейки; новый ключ начинается с V().
+		// fn должна быть короткой: читатели этой ячейки ждут, пока она не закончит.
+		// create == false - только существующие ключи. false - ключа нет / не влез
+		template <class Fn> bool Update(const char* key, Fn fn, bool create = true) {
+			size_t len = strlen(key);
+			if (len > MaxKey)
+				return false;
+			uint64_t hash = Hash(key, len);
+			Slot* slot = create ? Claim(key, len, hash) : const_cast<Slot*>(Lookup(key, len, hash));
+			if (slot == NULL)
+				return false;
+			uint32_t seq = LockSlot(*slot);
+			if (!slot->alive) {
+				if (!create) {
+					UnlockSlot(*slot, seq);
+					return false;
+				}
+				slot->value = V();
+				slot->alive = 1;
+			}
+			fn(slot->value);
+			UnlockSlot(*slot, seq);
+			return true;
+		}
+		bool Erase(const char* key) {
+			size_t len = strlen(key);
+			if (len > MaxKey)
+				return false;
+			Slot* slot = const_cast<Slot*>(Lookup(key, len, Hash(key, len)));
+			if (slot == NULL)
+				return false;
+			uint32_t seq = LockSlot(*slot);
+			bool erased = slot->alive != 0;
+			slot->alive = 0;
+			UnlockSlot(*slot, seq);
+			return erased;
+		}
+		// Освободить все ячейки. Только когда никто другой таблицей не пользуется
+		void Clear() {
+			for (size_t i = 0; i < Capacity; i++) {
+				_slots[i].seq.store(0, std::memory_order_release);
+				_slots[i].owner.store(0, std::memory_order_release);
+			}
+		}
+		// fn(const char* key, const V& value) для каждого живого ключа; значения - согласованные копии
+		template <class Fn> void ForEach(Fn fn) const {
+			for (size_t i = 0; i < Capacity; i++) {
+				const Slot& slot = _slots[i];
+				if (!WaitKey(slot))
+					continue;
+				V value;
+				if (ReadValue(slot, value))
+					fn(slot.key, value);
+			}
+		}
+		ShmHashStats Stats() const {
+			ShmHashStats stats = {Capacity, 0, 0, 0.0, 0.0, 0};
+			size_t probes = 0;
+			for (size_t i = 0; i < Capacity; i++) {
+				const Slot& slot = _slots[i];
+				if (!WaitKey(slot))
+					continue;
+				V value;
+				if (!ReadValue(slot, value)) {
+					stats.erased++;
+					continue;
+				}
+				size_t probe = ((i - static_cast<size_t>(slot.hash)) & (Capacity - 1)) + 1;
+				probes += probe;
+				if (probe > stats.max_probe)
+					stats.max_probe = probe;
+				stats.size++;
+			}
+			stats.load_factor = static_cast<double>(stats.size + stats.erased) / Capacity;
+			stats.mean_probe = stats.size ? static_cast<double>(probes) / stats.size : 0.0;
+			return stats;
+		}
+	private:
+		// seq: 0 - ячейка свободна, 1 - ее занимает ключ, нечетная - идет запись значения,
+		// четная > 0 - hash и key записаны и больше не меняются.
+		// seq и owner меняют и читатели, когда забирают ячейку у мертвого писателя
+		struct Slot
+		{
+			mutable std::atomic<uint32_t> seq;
+			mutable std::atomic<int32_t> owner;   // pid писателя ячейки, 0 - никто не пишет
+			uint64_t hash;
+			uint32_t alive;       // под seq: 0 - ключ удален
+			char key[KeyLen];
+			V value;              // под seq
+		};
+
+		// Через сколько витков ожидания проверять, жив ли писатель ячейки
+		static const unsigned OwnerCheckSpins = 1024;
+
+		static uint64_t Hash(const char* key, size_t len) {
+			uint64_t hash = 14695981039346656037ULL;   // FNV-1a
+			for (size_t i = 0; i < len; i++) {
+				hash ^= static_cast<unsigned char>(key[i]);
+				hash *= 1099511628211ULL;
+			}
+			// у FNV младшие биты похожих ключей ("counter.1", "counter.2") ложатся рядом -
+			// перемешиваем, иначе линейное пробирование собирает длинные цепочки
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccdULL;
+			hash ^= hash >> 33;
+			return hash;
+		}
+		static void Backoff(unsigned& spins) {
+			if (++spins > 64)
+				sched_yield();
+		}
+		// getpid() в glibc - системный вызов, а нужен он на каждую блокировку ячейки.
+		// Запоминаем, а в ребенке после fork забываем
+		static std::atomic<int32_t>& CachedPid() {
+			static std::atomic<int32_t> pid(0);
+			return pid;
+		}
+		static void ForgetPid() {
+			CachedPid().store(0, std::memory_order_relaxed);
+		}
+		static int32_t SelfPid() {
+			int32_t pid = CachedPid().load(std::memory_order_relaxed);
+			if (pid == 0) {
+				static pthread_once_t once = PTHREAD_ONCE_INIT;
+				pthread_once(&once, [] { pthread_atfork(NULL, NULL, ForgetPid); });
+				pid = static_cast<int32_t>(getpid());
+				CachedPid().store(pid, std::memory_order_relaxed);
+			}
+			return pid;
+		}
+		static uint32_t NextSeq(uint32_t seq) {
+			// после 0xffffffff четная 0 означала бы "свободна" - перескакиваем на 2
+			return seq + 1 == 0 ? 2 : seq + 1;
+		}
+		// Писатель ячейки умер: забрать ее себе и доделать за него то, что можно.
+		// true - ячейка теперь наша (owner == наш pid)
+		static bool TakeOver(const Slot& slot) {
+			int32_t owner = slot.owner.load(std::memory_order_acquire);
+			if (owner == 0 || owner == SelfPid() || kill(owner, 0) == 0 || errno != ESRCH)
+				return false;
+			if (!slot.owner.compare_exchange_strong(owner, SelfPid(), std::memory_order_acquire))
+				return false;
+			uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+			if (seq == 1)
+				slot.seq.store(0, std::memory_order_release);              // ключ не дописан
+			else if ((seq & 1) != 0)
+				slot.seq.store(NextSeq(seq), std::memory_order_release);   // значение - как есть
+			return true;
+		}
+		// Для ждущих без блокировки: если писатель мертв, освободить ячейку за него
+		static void Recover(const Slot& slot, unsigned spins) {
+			if (spins % OwnerCheckSpins == OwnerCheckSpins - 1 && TakeOver(slot))
+				slot.owner.store(0, std::memory_order_release);
+		}
+		static void AcquireOwner(const Slot& slot) {
+			int32_t self = SelfPid();
+			for (unsigned spins = 0; ; Backoff(spins)) {
+				int32_t expected = 0;
+				if (slot.owner.load(std::memory_order_relaxed) == 0 &&
+				    slot.owner.compare_exchange_weak(expected, self, std::memory_order_acquire))
+					return;
+				if (spins % OwnerCheckSpins == OwnerCheckSpins - 1 && TakeOver(slot))
+					return;
+			}
+		}
+		// Дождаться, пока ключ в ячейке дозапишут. false - ячейка свободна
+		static bool WaitKey(const Slot& slot) {
+			for (unsigned spins = 0; ; Backoff(spins)) {
+				uint32_t seq = slot.seq.load(std::memory_order_acquire);
+				if (seq == 0)
+					return false;
+				if (seq != 1)
+					return true;
+				Recover(slot, spins);
+			}
+		}
+		static bool SameKey(const Slot& slot, const char* key, size_t len, uint64_t hash) {
+			return slot.hash == hash && memcmp(slot.key, key, len) == 0 && slot.key[len] == '\0';
+		}
+		// Ячейка ключа (живого или удаленного), NULL - ключа нет
+		const Slot* Lookup(const char* key, size_t len, uint64_t hash) const {
+			for (size_t i = 0; i < Capacity; i++) {
+				const Slot& slot = _slots[(hash + i) & (Capacity - 1)];
+				if (!WaitKey(slot))
+					return NULL;   // до свободной ячейки не нашли - ключа нет
+				if (SameKey(slot, key, len, hash))
+					return &slot;
+			}
+			return NULL;
+		}
+		// Ячейка ключа; если его нет - занять первую свободную по пути. NULL - таблица полна
+		Slot* Claim(const char* key, size_t len, uint64_t hash) {
+			for (size_t i = 0; i < Capacity; i++) {
+				Slot& slot = _slots[(hash + i) & (Capacity - 1)];
+				// свободна - занимаем под owner; пока ждали owner, ее мог занять другой ключ
+				// (или тот же - другим процессом)
+				while (!WaitKey(slot)) {
+					AcquireOwner(slot);
+					bool free = slot.seq.load(std::memory_order_relaxed) == 0;
+					if (free) {
+						slot.seq.store(1, std::memory_order_relaxed);
+						slot.hash = hash;
+						memcpy(slot.key, key, len);
+						slot.key[len] = '\0';
+						slot.alive = 0;
+						slot.seq.store(2, std::memory_order_release);
+					}
+					slot.owner.store(0, std::memory_order_release);
+					if (free)
+						return &slot;
+				}
+				if (SameKey(slot, key, len, hash))
+					return &slot;
+			}
+			return NULL;
+		}
+		uint32_t LockSlot(Slot& slot) {
+			AcquireOwner(slot);
+			uint32_t seq = slot.seq.load(std::memory_order_relaxed) + 1;
+			slot.seq.store(seq, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			return seq;
+		}
+		void UnlockSlot(Slot& slot, uint32_t seq) {
+			slot.seq.store(NextSeq(seq), std::memory_order_release);
+			slot.owner.store(0, std::memory_order_release);
+		}
+		// Согласованная копия значения. false - ключ удален
+		static bool ReadValue(const Slot& slot, V& out) {
+			for (unsigned spins = 0; ; Backoff(spins)) {
+				uint32_t before = slot.seq.load(std::memory_order_acquire);
+				if ((before & 1) != 0) {
+					Recover(slot, spins);
+					continue;
+				}
+				uint32_t alive = slot.alive;
+				memcpy(&out, &slot.value, sizeof(V));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.seq.load(std::memory_order_relaxed) == before)
+					return alive != 0;
+			}
+		}
+
+		Slot _slots[Capacity];
+
+		// Защита от копирования
+		ShmHashTable(ShmHashTable const&) {}
+		ShmHashTable& operator=(ShmHashTable const&) { return *this; }
+	};
+}
+
+#endif // WIN32
@@ -0,0 +1,70 @@
+#pragma once
+
+// Мьютекс, который лежит прямо в разделяемом сегменте.
+// Свободный захват и освобождение - атомарная операция в user space (futex внутри
+// pthread), в ядро идем только при конкуренции. Мьютекс робастный: если владелец умер,
+// не отпустив его, ядро помечает futex, и следующий Lock() получает его с
+// LOCK_OWNER_DIED вместо вечного ожидания
+
+namespace cplib
+{
+	// Результат захвата
+	enum LockResult
+	{
+		LOCK_OK = 0,          // Обычный захват
+		LOCK_OWNER_DIED = 1,  // Предыдущий владелец умер под блокировкой: данные могли остаться недописанными
+		LOCK_FAILED = -1      // Мьютекс неисправим (владелец умер, а его наследник не восстановил)
+	};
+}
+
+#if !defined (WIN32)
+
+#include <pthread.h>
+#include <errno.h>
+
+namespace cplib
+{
+	class SharedMutex
+	{
+	public:
+		// Конструируется один раз создателем сегмента (placement new), остальные только подключаются
+		SharedMutex() {
+			pthread_mutexattr_t attr;
+			pthread_mutexattr_init(&attr);
+			pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+			pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+			pthread_mutex_init(&_mutex, &attr);
+			pthread_mutexattr_destroy(&attr);
+		}
+		LockResult Lock() {
+			return Result(pthread_mutex_lock(&_mutex));
+		}
+		// LOCK_FAILED - занят (или неисправим)
+		LockResult TryLock() {
+			return Result(pthread_mutex_trylock(&_mutex));
+		}
+		void Unlock() {
+			pthread_mutex_unlock(&_mutex);
+		}
+	private:
+		LockResult Result(int ret) {
+			if (ret == 0)
+				return LOCK_OK;
+			if (ret == EOWNERDEAD) {
+				// Мы владельцы. Считаем состояние восстановленным: иначе после Unlock()
+				// мьютекс станет неисправимым для всех. Проверить данные - дело вызывающего
+				pthread_mutex_consistent(&_mutex);
+				return LOCK_OWNER_DIED;
+			}
+			return LOCK_FAILED;
+		}
+
+		pthread_mutex_t _mutex;
+
+		// Защита от копирования
+		SharedMutex(SharedMutex const&) {}
+		SharedMutex& operator=(SharedMutex const&) { return *this; }
+	};
+}
+
+#endif // WIN32
@@ -0,0 +1,255 @@
+#pragma once
+
+// Кольцевые очереди для обмена между процессами через общий сегмент.
+// Кладутся целиком в SharedMem<Ring> или в SharedArena (FindOrConstruct).
+// На быстром пути никаких семафоров и системных вызовов: только атомарные индексы,
+// разнесенные по разным строкам кэша, чтобы писатель и читатель не дрались за одну строку.
+// С Blocking = true доступны Push()/Pop() с ожиданием на futex, когда очередь полна/пуста;
+// без него ни один push/pop не платит за проверку ждущих.
+
+#if !defined (WIN32)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <time.h>
+#include <atomic>
+#include <type_traits>
+
+#include "futex.hpp"
+
+#ifndef CPLIB_CACHE_LINE
+#	define CPLIB_CACHE_LINE 64
+#endif
+
+namespace cplib
+{
+	// Счетчик событий для ожидания "очередь стала непустой/неполной"
+	struct RingSignal
+	{
+		std::atomic<uint32_t> seq;
+		std::atomic<uint32_t> waiters;
+
+		RingSignal() :seq(0), waiters(0) {}
+
+		// После того как индексы очереди уже сдвинуты
+		void Notify() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiters.load(std::memory_order_relaxed) != 0) {
+				seq.fetch_add(1);
+				FutexWake(&seq, INT_MAX);
+			}
+		}
+		// Ждать, пока ready() не вернет true. false - вышел timeout (< 0 - ждать вечно)
+		template <class Ready> bool Wait(Ready ready, double timeout) {
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			while (!ready()) {
+				double left = -1.0;
+				if (timeout >= 0.0) {
+					struct timespec now;
+					clock_gettime(CLOCK_MONOTONIC, &now);
+					left = timeout - ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9);
+					if (left <= 0.0)
+						return false;
+				}
+				waiters.fetch_add(1);
+				uint32_t s = seq.load();
+				// проверка после регистрации: Notify() либо увидит нас, либо мы - его изменения
+				if (!ready())
+					FutexWait(&seq, s, left);
+				waiters.fetch_sub(1);
+			}
+			return true;
+		}
+	};
+
+	// Один писатель, один читатель. Каждая сторона держит у себя копию чужого индекса
+	// и перечитывает его, только когда по копии очередь кажется полной/пустой
+	template <class T, size_t Capacity, bool Blocking = false> class SpscRing
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+		static_assert(std::is_trivially_copyable<T>::value, "T is copied between processes as raw bytes");
+	public:
+		SpscRing() :_tail(0), _head_cache(0), _head(0), _tail_cache(0) {}
+
+		bool TryPush(const T& item) { return PushBatch(&item, 1) == 1; }
+		bool TryPop(T& item) { return PopBatch(&item, 1) == 1; }
+
+		// Положить сколько влезет из count элементов, вернуть сколько положили
+		size_t PushBatch(const T* items, size_t count) {
+			uint64_t tail = _tail.load(std::memory_order_relaxed);
+			if (Capacity - (tail - _head_cache) < count)
+				_head_cache = _head.load(std::memory_order_acquire);
+			size_t room = Capacity - static_cast<size_t>(tail - _head_cache);
+			size_t n = count < room ? count : room;
+			if (n == 0)
+				return 0;
+			for (size_t i = 0; i < n; i++)
+				_slots[(tail + i) & (Capacity - 1)] = items[i];
+			_tail.store(tail + n, std::memory_order_release);
+			if (Blocking)
+				_not_empty.Notify();
+			return n;
+		}
+		// Забрать до count элементов, вернуть сколько забрали
+		size_t PopBatch(T* items, size_t count) {
+			uint64_t head = _head.load(std::memory_order_relaxed);
+			if (_tail_cache - head < count)
+				_tail_cache = _tail.load(std::memory_order_acquire);
+			size_t ready = static_cast<size_t>(_tail_cache - head);
+			size_t n = count < ready ? count : ready;
+			if (n == 0)
+				return 0;
+			for (size_t i = 0; i < n; i++)
+				items[i] = _slots[(head + i) & (Capacity - 1)];
+			_head.store(head + n, std::memory_order_release);
+			if (Blocking)
+				_not_full.Notify();
+			return n;
+		}
+
+		// С ожиданием места/данных. false - вышел timeout (< 0 - ждать вечно)
+		bool Push(const T& item, double timeout = -1.0) {
+			static_assert(Blocking, "Push() with waiting needs Blocking = true");
+			while (!TryPush(item)) {
+				if (!_not_full.Wait([this] { return Size() < Capacity; }, timeout))
+					return false;
+			}
+			return true;
+		}
+		bool Pop(T& item, double timeout = -1.0) {
+			static_assert(Blocking, "Pop() with waiting needs Blocking = true");
+			while (!TryPop(item)) {
+				if (!_not_empty.Wait([this] { return Size() > 0; }, timeout))
+					return false;
+			}
+			return true;
+		}
+
+		size_t Size() const {
+			return static_cast<size_t>(_tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire));
+		}
+	private:
+		// строка писателя
+		alignas(CPLIB_CACHE_LINE) std::atomic<uint64_t> _tail;
+		uint64_t _head_cache;
+		// строка читателя
+		alignas(CPLIB_CACHE_LINE) std::atomic<uint64_t> _head;
+		uint64_t _tail_cache;
+		// ждущие трогают ее, только когда засыпают
+		alignas(CPLIB_CACHE_LINE) RingSignal _not_empty;
+		RingSignal _not_full;
+		alignas(CPLIB_CACHE_LINE) T _slots[Capacity];
+	};
+
+	// Много писателей и читателей (очередь Вьюкова): у каждой ячейки свой номер,
+	// по которому видно, свободна она для позиции pos или уже заполнена.
+	// Пакет занимается одним CAS на весь диапазон подряд готовых ячеек
+	template <class T, size_t Capacity, bool Blocking = false> class MpmcRing
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+		static_assert(std::is_trivially_copyable<T>::value, "T is copied between processes as raw bytes");
+	public:
+		MpmcRing() :_enqueue(0), _dequeue(0) {
+			for (size_t i = 0; i < Capacity; i++)
+				_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+
+		bool TryPush(const T& item) { return PushBatch(&item, 1) == 1; }
+		bool TryPop(T& item) { return PopBatch(&item, 1) == 1; }
+
+		size_t PushBatch(const T* items, size_t count) {
+			uint64_t pos = _enqueue.load(std::memory_order_relaxed);
+			size_t n = 0;
+			while (true) {
+				// ячейка pos + n свободна, если ее номер равен pos + n
+				n = 0;
+				while (n < count && _cells[(pos + n) & (Capacity - 1)].seq.load(std::memory_order_acquire) == pos + n)
+					n++;
+				if (n == 0) {
+					int64_t diff = static_cast<int64_t>(_cells[pos & (Capacity - 1)].seq.load(std::memory_order_acquire) - pos);
+					if (diff < 0)
+						return 0;   // полна
+					pos = _enqueue.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (_enqueue.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+					break;
+			}
+			for (size_t i = 0; i < n; i++) {
+				Cell& cell = _cells[(pos + i) & (Capacity - 1)];
+				cell.data = items[i];
+				cell.seq.store(pos + i + 1, std::memory_order_release);
+			}
+			if (Blocking)
+				_not_empty.Notify();
+			return n;
+		}
+		size_t PopBatch(T* items, size_t count) {
+			uint64_t pos = _dequeue.load(std::memory_order_relaxed);
+			size_t n = 0;
+			while (true) {
+				// ячейка pos + n заполнена, если ее номер равен pos + n + 1
+				n = 0;
+				while (n < count && _cells[(pos + n) & (Capacity - 1)].seq.load(std::memory_order_acquire) == pos + n + 1)
+					n++;
+				if (n == 0) {
+					int64_t diff = static_cast<int64_t>(_cells[pos & (Capacity - 1)].seq.load(std::memory_order_acquire) - (pos + 1));
+					if (diff < 0)
+						return 0;   // пуста
+					pos = _dequeue.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (_dequeue.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+					break;
+			}
+			for (size_t i = 0; i < n; i++) {
+				Cell& cell = _cells[(pos + i) & (Capacity - 1)];
+				items[i] = cell.data;
+				cell.seq.store(pos + i + Capacity, std::memory_order_release);
+			}
+			if (Blocking)
+				_not_full.Notify();
+			return n;
+		}
+
+		bool Push(const T& item, double timeout = -1.0) {
+			static_assert(Blocking, "Push() with waiting needs Blocking = true");
+			while (!TryPush(item)) {
+				if (!_not_full.Wait([this] { return Size() < Capacity; }, timeout))
+					return false;
+			}
+			return true;
+		}
+		bool Pop(T& item, double timeout = -1.0) {
+			static_assert(Blocking, "Pop() with waiting needs Blocking = true");
+			while (!TryPop(item)) {
+				if (!_not_empty.Wait([this] { return Size() > 0; }, timeout))
+					return false;
+			}
+			return true;
+		}
+
+		// Примерный размер: индексы занимаются раньше, чем ячейки заполняются
+		size_t Size() const {
+			uint64_t enqueue = _enqueue.load(std::memory_order_acquire);
+			uint64_t dequeue = _dequeue.load(std::memory_order_acquire);
+			return enqueue > dequeue ? static_cast<size_t>(enqueue - dequeue) : 0;
+		}
+	private:
+		struct Cell
+		{
+			std::atomic<uint64_t> seq;
+			T data;
+		};
+
+		alignas(CPLIB_CACHE_LINE) std::atomic<uint64_t> _enqueue;
+		alignas(CPLIB_CACHE_LINE) std::atomic<uint64_t> _dequeue;
+		alignas(CPLIB_CACHE_LINE) RingSignal _not_empty;
+		RingSignal _not_full;
+		alignas(CPLIB_CACHE_LINE) Cell _cells[Capacity];
+	};
+}
+
+#endif // WIN32